@@ -0,0 +1,229 @@
+#pragma once
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <utility>
+
+// Positions written by different threads are kept this far apart so they
+// don't share a cache line.
+#define CONCURRENT_QUEUE_CACHE_LINE_SIZE    64
+
+// Bounded lock free queue for any number of producers and consumers
+// (Vyukov style). Every slot has a sequence number that tells producers and
+// consumers which lap of the ring the slot belongs to, so a push or pop is
+// a single compare and swap on the position and never waits for another
+// thread. Pushing to a full queue and popping from an empty one fails
+// instead of blocking.
+//
+// T has to be default constructible and assignable, values are assigned
+// into the slots and moved out of them.
+//
+// Usage example:
+//  MPMCQueue<io_completion, 256> completions;
+//  if (!completions.TryPush(completion))
+//      HandleFullQueue(completion);
+//  io_completion completion;
+//  while (completions.TryPop(&completion))
+//      FinishRead(&completion);
+//
+template <class T, uint32_t Capacity>
+class MPMCQueue
+{
+public:
+    MPMCQueue()
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "MPMCQueue capacity has to be a power of two");
+        Reset();
+    }
+
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    // Empties the queue, not safe while other threads use it.
+    void Reset()
+    {
+        writePosition.store(0, std::memory_order_relaxed);
+        readPosition.store(0, std::memory_order_relaxed);
+        for (uint32_t index = 0; index < Capacity; ++index)
+        {
+            slots[index].sequence.store(index, std::memory_order_relaxed);
+        }
+    }
+
+    template <class U>
+    bool TryPush(U &&value)
+    {
+        uint32_t position = writePosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot *slot = &slots[position & (Capacity - 1)];
+            const uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const int32_t difference = (int32_t)(sequence - position);
+            if (difference == 0)
+            {
+                if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot->value = std::forward<U>(value);
+                    slot->sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                // Slot still holds a value from the previous lap, queue is full
+                return false;
+            }
+            else
+            {
+                position = writePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryPop(T *outValue)
+    {
+        uint32_t position = readPosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot *slot = &slots[position & (Capacity - 1)];
+            const uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const int32_t difference = (int32_t)(sequence - (position + 1));
+            if (difference == 0)
+            {
+                if (readPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    *outValue = std::move(slot->value);
+                    slot->sequence.store(position + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                // Slot not published yet, queue is empty
+                return false;
+            }
+            else
+            {
+                position = readPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only a snapshot when other threads push or pop at the same time.
+    bool IsEmpty() const
+    {
+        return readPosition.load(std::memory_order_acquire) == writePosition.load(std::memory_order_acquire);
+    }
+
+    static uint32_t GetCapacity() { return Capacity; }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+
+    uint8_t pad0[CONCURRENT_QUEUE_CACHE_LINE_SIZE];
+    std::atomic<uint32_t> writePosition;
+    uint8_t pad1[CONCURRENT_QUEUE_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+    std::atomic<uint32_t> readPosition;
+    uint8_t pad2[CONCURRENT_QUEUE_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+    Slot slots[Capacity];
+    uint8_t pad3[CONCURRENT_QUEUE_CACHE_LINE_SIZE];
+};
+
+// Bounded lock free ring for exactly one producer and one consumer thread.
+// Cheaper than MPMCQueue, a push or pop is a plain store of the position.
+// Each side keeps a copy of the other sides position and only reads the
+// shared one when the copy says the ring is full or empty, so the two
+// threads rarely touch each others cache line.
+//
+// Usage example:
+//  SPSCRing<log_message, 1024> logMessages;
+//  logMessages.TryPush(message);           // game thread
+//  while (logMessages.TryPop(&message))    // log thread
+//      WriteLogMessage(&message);
+//
+template <class T, uint32_t Capacity>
+class SPSCRing
+{
+public:
+    SPSCRing()
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SPSCRing capacity has to be a power of two");
+        Reset();
+    }
+
+    SPSCRing(const SPSCRing &) = delete;
+    SPSCRing &operator=(const SPSCRing &) = delete;
+
+    // Empties the ring, not safe while other threads use it.
+    void Reset()
+    {
+        writePosition.store(0, std::memory_order_relaxed);
+        cachedReadPosition = 0;
+        readPosition.store(0, std::memory_order_relaxed);
+        cachedWritePosition = 0;
+    }
+
+    // Producer thread only
+    template <class U>
+    bool TryPush(U &&value)
+    {
+        const uint32_t position = writePosition.load(std::memory_order_relaxed);
+        if (position - cachedReadPosition == Capacity)
+        {
+            cachedReadPosition = readPosition.load(std::memory_order_acquire);
+            if (position - cachedReadPosition == Capacity)
+            {
+                return false;
+            }
+        }
+
+        values[position & (Capacity - 1)] = std::forward<U>(value);
+        writePosition.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool TryPop(T *outValue)
+    {
+        const uint32_t position = readPosition.load(std::memory_order_relaxed);
+        if (position == cachedWritePosition)
+        {
+            cachedWritePosition = writePosition.load(std::memory_order_acquire);
+            if (position == cachedWritePosition)
+            {
+                return false;
+            }
+        }
+
+        *outValue = std::move(values[position & (Capacity - 1)]);
+        readPosition.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a snapshot when the other thread pushes or pops at the same time.
+    bool IsEmpty() const
+    {
+        return readPosition.load(std::memory_order_acquire) == writePosition.load(std::memory_order_acquire);
+    }
+
+    static uint32_t GetCapacity() { return Capacity; }
+
+private:
+    // Producer side
+    uint8_t pad0[CONCURRENT_QUEUE_CACHE_LINE_SIZE];
+    std::atomic<uint32_t> writePosition;
+    uint32_t cachedReadPosition;
+    uint8_t pad1[CONCURRENT_QUEUE_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+
+    // Consumer side
+    std::atomic<uint32_t> readPosition;
+    uint32_t cachedWritePosition;
+    uint8_t pad2[CONCURRENT_QUEUE_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+
+    T values[Capacity];
+    uint8_t pad3[CONCURRENT_QUEUE_CACHE_LINE_SIZE];
+};
\ No newline at end of file
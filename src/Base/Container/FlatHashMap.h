@@ -0,0 +1,474 @@
+#pragma once
+#include <stdint.h>
+#include <assert.h>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include "Base/Memory.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Open addressing hash map with SwissTable style probing. Every slot has a
+// control byte holding 7 bits of the hash of its key, lookups compare a
+// group of 16 control bytes at once and only compare keys of the slots
+// that match. Entries are stored inline, so there is no allocation per
+// entry and no pointer chasing.
+//
+// The interface follows std::unordered_map for the parts the engine uses,
+// but inserting invalidates iterators and pointers to entries, and clear()
+// keeps the memory for the next use. Erasing doesn't move other entries,
+// erase(iterator) can be used while iterating. Keys must not be modified
+// through an iterator.
+//
+// Usage example:
+//  FlatHashMap<uint32_t, std::shared_ptr<ITexture2D>> imageCache;
+//  imageCache.reserve(256);
+//  imageCache[hashKey] = image;
+//
+template <class TKey, class T, class Hasher = std::hash<TKey>, class KeyEqual = std::equal_to<TKey>, class Allocator = std::allocator<std::pair<TKey, T>>>
+class FlatHashMap
+{
+public:
+    typedef std::pair<TKey, T> value_type;
+
+    template <class TValue>
+    class IteratorBase
+    {
+    public:
+        IteratorBase() : control(nullptr), slot(nullptr) {}
+        IteratorBase(const int8_t *inControl, TValue *inSlot) : control(inControl), slot(inSlot) { SkipUnused(); }
+
+        // iterator to const_iterator
+        template <class UValue>
+        IteratorBase(const IteratorBase<UValue> &other) : control(other.control), slot(other.slot) {}
+
+        TValue &operator*() const { return *slot; }
+        TValue *operator->() const { return slot; }
+        IteratorBase &operator++() { ++control; ++slot; SkipUnused(); return *this; }
+        bool operator==(const IteratorBase &other) const { return slot == other.slot; }
+        bool operator!=(const IteratorBase &other) const { return slot != other.slot; }
+
+    private:
+        // The sentinel after the last slot stops the scan
+        void SkipUnused()
+        {
+            while (control && *control < ControlSentinel)
+            {
+                ++control;
+                ++slot;
+            }
+        }
+
+        const int8_t *control;
+        TValue *slot;
+
+        template <class UValue> friend class IteratorBase;
+        friend class FlatHashMap;
+    };
+
+    typedef IteratorBase<value_type> iterator;
+    typedef IteratorBase<const value_type> const_iterator;
+
+    explicit FlatHashMap(const Allocator &inAllocator = Allocator()) :
+        allocator(inAllocator)
+    {
+        InitEmpty();
+    }
+
+    FlatHashMap(FlatHashMap &&other) :
+        allocator(other.allocator)
+    {
+        InitEmpty();
+        Swap(other);
+    }
+
+    FlatHashMap &operator=(FlatHashMap &&other)
+    {
+        if (this != &other)
+        {
+            FreeMemory();
+            Swap(other);
+        }
+
+        return *this;
+    }
+
+    FlatHashMap(const FlatHashMap &) = delete;
+    FlatHashMap &operator=(const FlatHashMap &) = delete;
+
+    ~FlatHashMap()
+    {
+        FreeMemory();
+    }
+
+    iterator begin() { return iterator(control, slots); }
+    iterator end() { return iterator(nullptr, slots + slotCapacity); }
+    const_iterator begin() const { return const_iterator(control, slots); }
+    const_iterator end() const { return const_iterator(nullptr, slots + slotCapacity); }
+
+    size_t size() const { return numEntries; }
+    bool empty() const { return numEntries == 0; }
+    size_t capacity() const { return slotCapacity; }
+
+    iterator find(const TKey &key)
+    {
+        const size_t index = FindIndex(key);
+        return (index != InvalidIndex) ? iterator(control + index, slots + index) : end();
+    }
+
+    const_iterator find(const TKey &key) const
+    {
+        const size_t index = FindIndex(key);
+        return (index != InvalidIndex) ? const_iterator(control + index, slots + index) : end();
+    }
+
+    size_t count(const TKey &key) const
+    {
+        return FindIndex(key) != InvalidIndex ? 1 : 0;
+    }
+
+    T &operator[](const TKey &key)
+    {
+        const size_t hash = HashKey(key);
+        size_t index = FindIndex(key, hash);
+        if (index == InvalidIndex)
+        {
+            index = PrepareInsert(hash);
+            new (&slots[index]) value_type(key, T());
+        }
+
+        return slots[index].second;
+    }
+
+    size_t erase(const TKey &key)
+    {
+        const size_t index = FindIndex(key);
+        if (index == InvalidIndex)
+        {
+            return 0;
+        }
+
+        EraseIndex(index);
+        return 1;
+    }
+
+    iterator erase(const_iterator position)
+    {
+        const size_t index = position.slot - slots;
+        assert(index < slotCapacity && control[index] >= 0);
+        EraseIndex(index);
+        return iterator(control + index, slots + index);
+    }
+
+    // Make room for numReserved entries without growing again.
+    void reserve(size_t numReserved)
+    {
+        if (numReserved > numEntries + growthLeft)
+        {
+            Resize(NormalizeCapacity(GrowthToCapacity(numReserved)));
+        }
+    }
+
+    // Remove all entries, the memory is kept.
+    void clear()
+    {
+        for (size_t index = 0; index < slotCapacity; ++index)
+        {
+            if (control[index] >= 0)
+            {
+                slots[index].~value_type();
+            }
+        }
+
+        ResetControl();
+    }
+
+private:
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<value_type> SlotAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<int8_t> ControlAllocator;
+
+    // Control byte values, full slots hold the 7 bit hash of their key
+    static const int8_t ControlEmpty = -128;
+    static const int8_t ControlDeleted = -2;
+    static const int8_t ControlSentinel = -1;
+
+    static const size_t GroupWidth = 16;
+    static const size_t MinCapacity = GroupWidth - 1;
+    static const size_t InvalidIndex = ~(size_t)0;
+
+    //
+    // Control groups
+    //
+
+#if MEMORY_HAS_SSE2
+    static uint32_t MatchByte(const int8_t *group, int8_t value)
+    {
+        const __m128i controlBytes = _mm_loadu_si128((const __m128i *)group);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(controlBytes, _mm_set1_epi8(value)));
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const int8_t *group)
+    {
+        const __m128i controlBytes = _mm_loadu_si128((const __m128i *)group);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(ControlSentinel), controlBytes));
+    }
+#else
+    static uint32_t MatchByte(const int8_t *group, int8_t value)
+    {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < GroupWidth; ++i)
+        {
+            mask |= (group[i] == value) ? (1u << i) : 0;
+        }
+
+        return mask;
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const int8_t *group)
+    {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < GroupWidth; ++i)
+        {
+            mask |= (group[i] < ControlSentinel) ? (1u << i) : 0;
+        }
+
+        return mask;
+    }
+#endif
+
+    static uint32_t LowestSetBit(uint32_t mask)
+    {
+        assert(mask != 0);
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    //
+    // Sizing, the capacity is always a power of two minus one so it can be used
+    // as the probe mask. Tables are kept at most 7/8 full.
+    //
+
+    static size_t CapacityToGrowth(size_t numSlots)
+    {
+        return numSlots - numSlots / 8;
+    }
+
+    static size_t GrowthToCapacity(size_t growth)
+    {
+        return growth + (growth - 1) / 7;
+    }
+
+    static size_t NormalizeCapacity(size_t numSlots)
+    {
+        size_t result = MinCapacity;
+        while (result < numSlots)
+        {
+            result = result * 2 + 1;
+        }
+
+        return result;
+    }
+
+    //
+    // Hashing, the hash is mixed so weak hashers like identity hashes of
+    // integers spread over the whole table. The high 7 bits are stored in
+    // the control bytes, the rest picks the first group to probe.
+    //
+
+    size_t HashKey(const TKey &key) const
+    {
+        const uint64_t mixed = (uint64_t)hasher(key) * UINT64_C(0x9e3779b97f4a7c15);
+        return (size_t)(mixed >> 32) ^ (size_t)mixed;
+    }
+
+    static size_t H1(size_t hash) { return hash >> 7; }
+    static int8_t H2(size_t hash) { return (int8_t)(hash & 0x7f); }
+
+    size_t FindIndex(const TKey &key) const
+    {
+        return FindIndex(key, HashKey(key));
+    }
+
+    size_t FindIndex(const TKey &key, size_t hash) const
+    {
+        if (!slotCapacity)
+        {
+            return InvalidIndex;
+        }
+
+        const int8_t h2 = H2(hash);
+        size_t position = H1(hash) & slotCapacity;
+        size_t probeOffset = 0;
+        for (;;)
+        {
+            const int8_t *group = control + position;
+            for (uint32_t match = MatchByte(group, h2); match; match &= match - 1)
+            {
+                const size_t index = (position + LowestSetBit(match)) & slotCapacity;
+                if (keyEqual(slots[index].first, key))
+                {
+                    return index;
+                }
+            }
+
+            if (MatchByte(group, ControlEmpty))
+            {
+                return InvalidIndex;
+            }
+
+            // Triangular probing visits every group once
+            probeOffset += GroupWidth;
+            position = (position + probeOffset) & slotCapacity;
+            assert(probeOffset <= slotCapacity);
+        }
+    }
+
+    size_t FindFirstNonFull(size_t hash) const
+    {
+        size_t position = H1(hash) & slotCapacity;
+        size_t probeOffset = 0;
+        for (;;)
+        {
+            const uint32_t match = MatchEmptyOrDeleted(control + position);
+            if (match)
+            {
+                return (position + LowestSetBit(match)) & slotCapacity;
+            }
+
+            probeOffset += GroupWidth;
+            position = (position + probeOffset) & slotCapacity;
+            assert(probeOffset <= slotCapacity);
+        }
+    }
+
+    // Find a slot for a key that isn't in the map and mark it as full, the
+    // caller constructs the entry.
+    size_t PrepareInsert(size_t hash)
+    {
+        size_t index = slotCapacity ? FindFirstNonFull(hash) : 0;
+        if (!slotCapacity || (!growthLeft && control[index] != ControlDeleted))
+        {
+            // Mostly tombstones, rehash in place, otherwise grow
+            const size_t newCapacity = (slotCapacity && numEntries <= CapacityToGrowth(slotCapacity) / 2) ? slotCapacity : NormalizeCapacity(slotCapacity * 2 + 1);
+            Resize(newCapacity);
+            index = FindFirstNonFull(hash);
+        }
+
+        growthLeft -= (control[index] == ControlEmpty) ? 1 : 0;
+        SetControl(index, H2(hash));
+        ++numEntries;
+        return index;
+    }
+
+    void EraseIndex(size_t index)
+    {
+        slots[index].~value_type();
+        SetControl(index, ControlDeleted);
+        --numEntries;
+    }
+
+    // The first GroupWidth - 1 control bytes are cloned after the sentinel
+    // so a group can be loaded from any slot without wrapping.
+    void SetControl(size_t index, int8_t value)
+    {
+        control[index] = value;
+        control[((index - (GroupWidth - 1)) & slotCapacity) + (GroupWidth - 1)] = value;
+    }
+
+    void ResetControl()
+    {
+        if (slotCapacity)
+        {
+            memset(control, ControlEmpty, slotCapacity + GroupWidth);
+            control[slotCapacity] = ControlSentinel;
+        }
+
+        numEntries = 0;
+        growthLeft = CapacityToGrowth(slotCapacity);
+    }
+
+    void Resize(size_t newCapacity)
+    {
+        int8_t *oldControl = control;
+        value_type *oldSlots = slots;
+        const size_t oldCapacity = slotCapacity;
+
+        ControlAllocator controlAllocator(allocator);
+        SlotAllocator slotAllocator(allocator);
+        control = std::allocator_traits<ControlAllocator>::allocate(controlAllocator, newCapacity + GroupWidth);
+        slots = std::allocator_traits<SlotAllocator>::allocate(slotAllocator, newCapacity);
+        slotCapacity = newCapacity;
+        ResetControl();
+
+        for (size_t oldIndex = 0; oldIndex < oldCapacity; ++oldIndex)
+        {
+            if (oldControl[oldIndex] >= 0)
+            {
+                const size_t hash = HashKey(oldSlots[oldIndex].first);
+                const size_t index = FindFirstNonFull(hash);
+                SetControl(index, H2(hash));
+                new (&slots[index]) value_type(std::move(oldSlots[oldIndex]));
+                oldSlots[oldIndex].~value_type();
+                ++numEntries;
+                --growthLeft;
+            }
+        }
+
+        if (oldCapacity)
+        {
+            std::allocator_traits<ControlAllocator>::deallocate(controlAllocator, oldControl, oldCapacity + GroupWidth);
+            std::allocator_traits<SlotAllocator>::deallocate(slotAllocator, oldSlots, oldCapacity);
+        }
+    }
+
+    void FreeMemory()
+    {
+        if (slotCapacity)
+        {
+            clear();
+
+            ControlAllocator controlAllocator(allocator);
+            SlotAllocator slotAllocator(allocator);
+            std::allocator_traits<ControlAllocator>::deallocate(controlAllocator, control, slotCapacity + GroupWidth);
+            std::allocator_traits<SlotAllocator>::deallocate(slotAllocator, slots, slotCapacity);
+        }
+
+        InitEmpty();
+    }
+
+    void InitEmpty()
+    {
+        control = nullptr;
+        slots = nullptr;
+        slotCapacity = 0;
+        numEntries = 0;
+        growthLeft = 0;
+    }
+
+    void Swap(FlatHashMap &other)
+    {
+        std::swap(allocator, other.allocator);
+        std::swap(control, other.control);
+        std::swap(slots, other.slots);
+        std::swap(slotCapacity, other.slotCapacity);
+        std::swap(numEntries, other.numEntries);
+        std::swap(growthLeft, other.growthLeft);
+    }
+
+    Allocator allocator;
+    Hasher hasher;
+    KeyEqual keyEqual;
+
+    int8_t *control;
+    value_type *slots;
+    size_t slotCapacity;            // Also the probe mask
+    size_t numEntries;
+    size_t growthLeft;
+};
\ No newline at end of file
@@ -1,51 +1,254 @@
 #pragma once
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <vector>
 
-// An insertion ordered map, hacked together quickly for 
-// usage with the profiler.
-template <class TKey, class T>
-class InsertionOrderedMap
+// Value storage for InsertionOrderedMap. Values are stored in one array,
+// or when pointers to them have to stay valid, in fixed size chunks that
+// never move.
+template <class T, bool StablePointers, size_t ChunkSize>
+class InsertionOrderedStorage;
+
+template <class T, size_t ChunkSize>
+class InsertionOrderedStorage<T, false, ChunkSize>
+{
+public:
+    T &operator[](size_t index) { return values[index]; }
+    const T &operator[](size_t index) const { return values[index]; }
+    size_t Num() const { return values.size(); }
+
+    void Add(const T &value) { values.push_back(value); }
+    void Reserve(size_t num) { values.reserve(num); }
+    void Clear() { values.clear(); }
+
+private:
+    std::vector<T> values;
+};
+
+template <class T, size_t ChunkSize>
+class InsertionOrderedStorage<T, true, ChunkSize>
 {
 public:
-    InsertionOrderedMap() {}
-    ~InsertionOrderedMap()
+    InsertionOrderedStorage() : num(0) {}
+    ~InsertionOrderedStorage()
     {
-        for (auto it : entries)
+        Clear();
+        for (T *chunk : chunks)
         {
-            delete it;
+            ::operator delete(chunk);
         }
     }
 
-    T *Find(const TKey key)
+    InsertionOrderedStorage(const InsertionOrderedStorage &) = delete;
+    InsertionOrderedStorage &operator=(const InsertionOrderedStorage &) = delete;
+
+    T &operator[](size_t index) { return chunks[index / ChunkSize][index % ChunkSize]; }
+    const T &operator[](size_t index) const { return chunks[index / ChunkSize][index % ChunkSize]; }
+    size_t Num() const { return num; }
+
+    void Add(const T &value)
+    {
+        Reserve(num + 1);
+        new (&(*this)[num]) T(value);
+        ++num;
+    }
+
+    void Reserve(size_t numReserved)
+    {
+        while (chunks.size() * ChunkSize < numReserved)
+        {
+            chunks.push_back((T *)::operator new(sizeof(T) * ChunkSize));
+        }
+    }
+
+    // Destroys the values, the chunks are kept.
+    void Clear()
+    {
+        for (size_t index = 0; index < num; ++index)
+        {
+            (*this)[index].~T();
+        }
+
+        num = 0;
+    }
+
+private:
+    std::vector<T *> chunks;
+    size_t num;
+};
+
+// Map that iterates its values in the order they were inserted. Values
+// are never removed, so the index of a value stays the same and can be
+// used instead of the key. Keys and values are stored contiguously, lookups
+// go through an open addressing table that only holds indices and compares
+// against the stored keys, so every key is stored once.
+//
+// Inserting moves the values unless StablePointers is set, then they're
+// stored in chunks of ChunkSize values and pointers stay valid until the
+// map is cleared.
+//
+// Usage example:
+//  InsertionOrderedMap<std::string, uint64_t> cycleCounts;
+//  *cycleCounts.Insert(name, 0) += cycleCount;
+//  for (auto it = cycleCounts.begin(); it != cycleCounts.end(); ++it)
+//      DebugPrintf("%s: %llu\n", cycleCounts.GetKey(it.GetIndex()).c_str(), *it);
+//
+template <class TKey, class T, bool StablePointers = false, size_t ChunkSize = 64, class Hasher = std::hash<TKey>>
+class InsertionOrderedMap
+{
+public:
+    static const size_t InvalidIndex = ~(size_t)0;
+
+    template <class TMap, class TValue>
+    class IteratorBase
+    {
+    public:
+        IteratorBase(TMap *inMap, size_t inIndex) : map(inMap), index(inIndex) {}
+
+        TValue &operator*() const { return (*map)[index]; }
+        TValue *operator->() const { return &(*map)[index]; }
+        IteratorBase &operator++() { ++index; return *this; }
+        bool operator==(const IteratorBase &other) const { return index == other.index; }
+        bool operator!=(const IteratorBase &other) const { return index != other.index; }
+
+        // Insertion index of the current value
+        size_t GetIndex() const { return index; }
+
+    private:
+        TMap *map;
+        size_t index;
+    };
+
+    typedef IteratorBase<InsertionOrderedMap, T> iterator;
+    typedef IteratorBase<const InsertionOrderedMap, const T> const_iterator;
+
+    T *Find(const TKey &key)
+    {
+        const size_t index = FindIndex(key);
+        return (index != InvalidIndex) ? &values[index] : nullptr;
+    }
+
+    const T *Find(const TKey &key) const
+    {
+        const size_t index = FindIndex(key);
+        return (index != InvalidIndex) ? &values[index] : nullptr;
+    }
+
+    size_t FindIndex(const TKey &key) const
     {
-        const auto searchResult = keyToIndexMap.find(key);
-        if (searchResult != std::end(keyToIndexMap))
+        const size_t slot = FindSlot(key);
+        return (slot != InvalidIndex && indexTable[slot] != EmptySlot) ? indexTable[slot] : InvalidIndex;
+    }
+
+    // Returns the value already stored for key if there is one.
+    T *Insert(const TKey &key, const T &value)
+    {
+        size_t slot = FindSlot(key);
+        if (slot != InvalidIndex && indexTable[slot] != EmptySlot)
         {
-            return entries[searchResult->second];
+            return &values[indexTable[slot]];
         }
 
-        return nullptr;
+        if ((keys.size() + 1) * 4 > indexTable.size() * 3)
+        {
+            Rehash(indexTable.empty() ? MinTableSize : indexTable.size() * 2);
+            slot = FindSlot(key);
+        }
+
+        assert(keys.size() < EmptySlot);
+        indexTable[slot] = (uint32_t)keys.size();
+        keys.push_back(key);
+        values.Add(value);
+        return &values[indexTable[slot]];
     }
 
-    T *Insert(const TKey key, const T &value)
+    void Reserve(size_t num)
     {
-        T *entry = Find(key);
-        if (!entry)
+        size_t tableSize = indexTable.empty() ? MinTableSize : indexTable.size();
+        while (num * 4 > tableSize * 3)
         {
-            size_t index = entries.size();
-            keyToIndexMap[key] = index;
-            entries.push_back(new T(value));
-            entry = entries[index];
+            tableSize *= 2;
         }
 
-        return entry;
+        if (tableSize != indexTable.size())
+        {
+            Rehash(tableSize);
+        }
+
+        keys.reserve(num);
+        values.Reserve(num);
     }
 
-    typename std::vector<T*>::iterator begin() { return entries.begin(); }
-    const typename std::vector<T*>::const_iterator begin() const { return entries.begin(); }
-    typename std::vector<T*>::iterator end() { return entries.end(); }
-    const typename std::vector<T*>::const_iterator end() const { return entries.end(); }
+    // Removes everything, the memory is kept.
+    void Clear()
+    {
+        std::fill(indexTable.begin(), indexTable.end(), EmptySlot);
+        keys.clear();
+        values.Clear();
+    }
+
+    T &operator[](size_t index) { assert(index < values.Num()); return values[index]; }
+    const T &operator[](size_t index) const { assert(index < values.Num()); return values[index]; }
+    const TKey &GetKey(size_t index) const { assert(index < keys.size()); return keys[index]; }
+    size_t Num() const { return values.Num(); }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, values.Num()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, values.Num()); }
 
 private:
-    std::unordered_map<TKey, size_t> keyToIndexMap;
-    std::vector<T*> entries;
+    // An enum so passing it by reference to std::fill doesn't need a definition
+    enum : uint32_t { EmptySlot = UINT32_MAX };
+    static const size_t MinTableSize = 16;
+
+    size_t HashKey(const TKey &key) const
+    {
+        const uint64_t mixed = (uint64_t)Hasher()(key) * UINT64_C(0x9e3779b97f4a7c15);
+        return (size_t)(mixed >> 32) ^ (size_t)mixed;
+    }
+
+    // Slot holding the index of key, or the empty slot where it would go.
+    // InvalidIndex while there is no table yet.
+    size_t FindSlot(const TKey &key) const
+    {
+        if (indexTable.empty())
+        {
+            return InvalidIndex;
+        }
+
+        const size_t mask = indexTable.size() - 1;
+        size_t slot = HashKey(key) & mask;
+        while (indexTable[slot] != EmptySlot && !(keys[indexTable[slot]] == key))
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        return slot;
+    }
+
+    void Rehash(size_t tableSize)
+    {
+        assert((tableSize & (tableSize - 1)) == 0);
+        indexTable.assign(tableSize, EmptySlot);
+        const size_t mask = tableSize - 1;
+        for (size_t index = 0; index < keys.size(); ++index)
+        {
+            size_t slot = HashKey(keys[index]) & mask;
+            while (indexTable[slot] != EmptySlot)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            indexTable[slot] = (uint32_t)index;
+        }
+    }
+
+    // Size is zero or a power of two, at most three quarters are used
+    std::vector<uint32_t> indexTable;
+    std::vector<TKey> keys;
+    InsertionOrderedStorage<T, StablePointers, ChunkSize> values;
 };
\ No newline at end of file
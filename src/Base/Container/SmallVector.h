@@ -0,0 +1,226 @@
+#pragma once
+#include <stdint.h>
+#include <assert.h>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Vector that keeps its first N elements inside the object and only
+// allocates when it grows past them. Meant for lists that are almost always
+// short, like the successors of a job graph node, where a std::vector would
+// cost one allocation for every few elements.
+//
+// The interface follows std::vector for the parts the engine uses. Moving
+// a vector that still uses its inline storage moves the elements one by
+// one, so pointers to elements only survive a move once it has allocated.
+//
+// Usage example:
+//  SmallVector<job_graph_node *, 4> successors;
+//  successors.push_back(node);
+//  for (job_graph_node *successor : successors)
+//      SubmitGraphNode(successor);
+//
+template <class T, size_t N, class Allocator = std::allocator<T>>
+class SmallVector
+{
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    explicit SmallVector(const Allocator &inAllocator = Allocator()) :
+        elements(InlineElements()),
+        num(0),
+        elementCapacity(N),
+        allocator(inAllocator)
+    {
+        static_assert(N > 0, "SmallVector needs room for at least one inline element");
+    }
+
+    SmallVector(const SmallVector &other) :
+        SmallVector(other.allocator)
+    {
+        reserve(other.num);
+        for (const T &value : other)
+        {
+            new (&elements[num++]) T(value);
+        }
+    }
+
+    SmallVector(SmallVector &&other) :
+        SmallVector(other.allocator)
+    {
+        MoveFrom(other);
+    }
+
+    SmallVector &operator=(const SmallVector &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other.num);
+            for (const T &value : other)
+            {
+                new (&elements[num++]) T(value);
+            }
+        }
+
+        return *this;
+    }
+
+    SmallVector &operator=(SmallVector &&other)
+    {
+        if (this != &other)
+        {
+            clear();
+            FreeMemory();
+            MoveFrom(other);
+        }
+
+        return *this;
+    }
+
+    ~SmallVector()
+    {
+        clear();
+        FreeMemory();
+    }
+
+    iterator begin() { return elements; }
+    iterator end() { return elements + num; }
+    const_iterator begin() const { return elements; }
+    const_iterator end() const { return elements + num; }
+
+    T *data() { return elements; }
+    const T *data() const { return elements; }
+    size_t size() const { return num; }
+    bool empty() const { return num == 0; }
+    size_t capacity() const { return elementCapacity; }
+
+    // True until the vector has grown past the inline elements
+    bool IsInline() const { return elements == InlineElements(); }
+
+    T &operator[](size_t index) { assert(index < num); return elements[index]; }
+    const T &operator[](size_t index) const { assert(index < num); return elements[index]; }
+    T &front() { assert(num > 0); return elements[0]; }
+    const T &front() const { assert(num > 0); return elements[0]; }
+    T &back() { assert(num > 0); return elements[num - 1]; }
+    const T &back() const { assert(num > 0); return elements[num - 1]; }
+
+    void push_back(const T &value) { emplace_back(value); }
+    void push_back(T &&value) { emplace_back(std::move(value)); }
+
+    template <class... Args>
+    T &emplace_back(Args &&... args)
+    {
+        if (num == elementCapacity)
+        {
+            // Construct the new element before the old ones move, the
+            // arguments may refer to them
+            T *newElements = allocator.allocate(elementCapacity * 2);
+            new (&newElements[num]) T(std::forward<Args>(args)...);
+            MoveElements(newElements, elementCapacity * 2);
+        }
+        else
+        {
+            new (&elements[num]) T(std::forward<Args>(args)...);
+        }
+
+        return elements[num++];
+    }
+
+    void pop_back()
+    {
+        assert(num > 0);
+        elements[--num].~T();
+    }
+
+    void reserve(size_t newCapacity)
+    {
+        if (newCapacity > elementCapacity)
+        {
+            MoveElements(allocator.allocate(newCapacity), newCapacity);
+        }
+    }
+
+    void resize(size_t newNum)
+    {
+        reserve(newNum);
+        while (num < newNum)
+        {
+            new (&elements[num++]) T();
+        }
+
+        while (num > newNum)
+        {
+            pop_back();
+        }
+    }
+
+    // Destroys the elements, allocated memory is kept.
+    void clear()
+    {
+        while (num > 0)
+        {
+            elements[--num].~T();
+        }
+    }
+
+private:
+    T *InlineElements() { return reinterpret_cast<T *>(inlineStorage); }
+    const T *InlineElements() const { return reinterpret_cast<const T *>(inlineStorage); }
+
+    void MoveElements(T *newElements, size_t newCapacity)
+    {
+        for (size_t index = 0; index < num; ++index)
+        {
+            new (&newElements[index]) T(std::move(elements[index]));
+            elements[index].~T();
+        }
+
+        FreeMemory();
+        elements = newElements;
+        elementCapacity = newCapacity;
+    }
+
+    // Takes the allocation of other, or moves its inline elements over
+    void MoveFrom(SmallVector &other)
+    {
+        assert(num == 0 && IsInline());
+        if (other.IsInline())
+        {
+            for (T &value : other)
+            {
+                new (&elements[num++]) T(std::move(value));
+            }
+
+            other.clear();
+        }
+        else
+        {
+            elements = other.elements;
+            num = other.num;
+            elementCapacity = other.elementCapacity;
+            other.elements = other.InlineElements();
+            other.num = 0;
+            other.elementCapacity = N;
+        }
+    }
+
+    void FreeMemory()
+    {
+        if (!IsInline())
+        {
+            allocator.deallocate(elements, elementCapacity);
+            elements = InlineElements();
+            elementCapacity = N;
+        }
+    }
+
+    T *elements;
+    size_t num;
+    size_t elementCapacity;
+    Allocator allocator;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type inlineStorage[N];
+};
\ No newline at end of file
@@ -1,29 +1,125 @@
 #pragma once
-#include "Memory.h"
+#include "Base/Memory.h"
 
-template <class T>
+// Arrays larger than this go to the heap, so one big array doesn't use up
+// the scratch pool for the small ones.
+#define TEMP_ARRAY_MAX_SCRATCH_SIZE     Kilobytes(256)
+
+enum temp_array_init
+{
+	TempArray_Construct,            // Value initialize the elements, zero for plain types
+	TempArray_Uninitialized         // Leave the memory as is, the elements are never destroyed
+};
+
+// A fixed size array that lives until the end of the scope. Taken from
+// the scratch pool of the calling thread, or the heap if the array is
+// large or the pool is missing or full. Scratch memory is a stack, temp
+// arrays have to be destroyed in reverse order of creation, which is what
+// happens to locals.
+//
+// Usage example:
+//  TempArray<job_graph_node *> RootNodes( Graph->Nodes.size(), TempArray_Uninitialized );
+//  TempArray<Vec4f, 16> Positions( NumVertices );
+//
+template <class T, size_t Alignment = ( alignof( T ) < 4 ? 4 : alignof( T ) )>
 class TempArray
 {
 public:
-	TempArray( size_t num )
+	explicit TempArray( size_t num, temp_array_init init = TempArray_Construct )
 	{
+		static_assert( Alignment >= 4 && ( Alignment & ( Alignment - 1 ) ) == 0, "TempArray alignment has to be a power of two of at least 4" );
+		static_assert( Alignment >= alignof( T ), "TempArray alignment is less than the alignment of the type" );
+
 		this->num = num;
-		buffer = (T *)Mem_Alloc( sizeof( T ) * num );
+		constructed = ( init == TempArray_Construct );
+		scratchPool = nullptr;
+		heapBuffer = nullptr;
+
+		const memory_index size = sizeof( T ) * num;
+		const uint32_t flags = AlignmentFlags();
+		if ( size <= TEMP_ARRAY_MAX_SCRATCH_SIZE )
+		{
+			scratchPool = GetThreadScratchPool();
+			if ( scratchPool && CanPushSize( scratchPool, size, flags ) )
+			{
+				tempMemory = PushTemporaryMemory( scratchPool );
+				tempCount = scratchPool->TempCount;
+				buffer = (T *)PushSize( scratchPool, size, flags );
+			}
+			else
+			{
+				scratchPool = nullptr;
+			}
+		}
+
+		if ( !scratchPool )
+		{
+			heapBuffer = (uint8_t *)::operator new( size + Alignment - 1 );
+			buffer = (T *)( ( (uintptr_t)heapBuffer + Alignment - 1 ) & ~(uintptr_t)( Alignment - 1 ) );
+		}
+
+		if ( constructed )
+		{
+			for ( size_t i = 0; i < num; ++i )
+			{
+				new ( &buffer[i] ) T();
+			}
+		}
 	}
 
 	~TempArray()
 	{
-		Mem_Free( buffer );
+		if ( constructed )
+		{
+			for ( size_t i = num; i > 0; --i )
+			{
+				buffer[i - 1].~T();
+			}
+		}
+
+		if ( scratchPool )
+		{
+			// A temp array created after this one is still alive
+			assert( scratchPool->TempCount == tempCount );
+			PopTemporaryMemory( &tempMemory );
+		}
+
+		::operator delete( heapBuffer );
 	}
 
+	TempArray( const TempArray & ) = delete;
+	TempArray &operator=( const TempArray & ) = delete;
+
 	T *Get() { return buffer; }
 	const T *Get() const { return buffer; }
 	size_t Size() const { return sizeof( T ) * num; }
 	size_t Num() const { return num; }
+	bool IsScratch() const { return scratchPool != nullptr; }
 	T &operator[]( size_t index ) { assert( index < num ); return buffer[index]; }
 	const T &operator[]( size_t index ) const { assert( index < num ); return buffer[index]; }
 
+	T *begin() { return buffer; }
+	T *end() { return buffer + num; }
+	const T *begin() const { return buffer; }
+	const T *end() const { return buffer + num; }
+
 private:
+	static uint32_t AlignmentFlags()
+	{
+		uint32_t flags = 0;
+		while ( ( (memory_index)4 << flags ) < Alignment )
+		{
+			++flags;
+		}
+
+		return flags;
+	}
+
 	T *buffer;
 	size_t num;
+	bool constructed;
+	memory_pool *scratchPool;
+	temporary_memory tempMemory;
+	int32_t tempCount;
+	uint8_t *heapBuffer;
 };
\ No newline at end of file
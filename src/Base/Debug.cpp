@@ -1,8 +1,13 @@
 #include "Precompiled.h"
 #include "Base/Debug.h"
 #include "Base/Algorithm.h"
+#include "Base/Container/InsertionOrderedMap.h"
 #include "Base/File.h"
+#include "Base/Memory.h"
 #include "Base/Sys.h"
+#include "Base/Timer.h"
+#include <atomic>
+#include <stdio.h>
 
 DebugPerformenceRecord *DebugPerformenceRecord::staticRecords = NULL;
 
@@ -13,13 +18,15 @@ FatalException::FatalException(const std::string &message) :
 {
 }
 
-const char *FatalException::what() const
+const char *FatalException::what() const noexcept
 {
     return errorMessage.c_str();
 }
 
 void DebugAddMessageToBuffer(const char *msg)
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Debug);
+
     // TODO: Use something better than a stream buffer to save messages
     logStream << msg;
 }
@@ -32,7 +39,7 @@ void DebugPrintf(const char *fmt, ...)
 
     va_list args;
     va_start(args, fmt);
-    _vsnprintf_s(msg, PRINT_BUFFER_SIZE, fmt, args);
+    vsnprintf(msg, PRINT_BUFFER_SIZE, fmt, args);
     va_end(args);
 
     Sys_Printf(msg);
@@ -61,24 +68,217 @@ ScoopedTimedBlock::ScoopedTimedBlock(DebugPerformenceRecord *inRecord)
 {
     record = inRecord;
     ++(record->hitCount);
+    DebugTraceEvent(DebugTraceEvent_Begin, record->functionName);
     record->cycleCount -= Sys_GetClockTicks();
 }
 
 ScoopedTimedBlock::~ScoopedTimedBlock()
 {
     record->cycleCount += Sys_GetClockTicks();
+    DebugTraceEvent(DebugTraceEvent_End, record->functionName);
 }
 
 void DebugLogPerformanceCounters(const DebugPerformenceRecord *record)
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Debug);
     DebugPrintf("--------< Performance Counters >-----------------------------------------------------------\n");
 
+    // Records with the same name, like the instances of a template function
+    // or a named block used in several places, are added up
+    struct PerformanceTotals
+    {
+        uint64_t cycleCount;
+        uint64_t hitCount;
+    };
+
+    InsertionOrderedMap<std::string, PerformanceTotals> totals;
     for (; record != NULL; record = record->next)
     {
-        DebugPrintf("%s: CycleCount=%llu HitCount=%d AvgCycleCount=%d\n",
-                    record->functionName,
-                    record->cycleCount,
-                    record->hitCount,
-                    record->cycleCount / record->hitCount);
+        PerformanceTotals *total = totals.Insert(record->functionName, PerformanceTotals{ 0, 0 });
+        total->cycleCount += record->cycleCount;
+        total->hitCount += record->hitCount;
+    }
+
+    for (auto it = totals.begin(); it != totals.end(); ++it)
+    {
+        DebugPrintf("%s: CycleCount=%llu HitCount=%llu AvgCycleCount=%llu\n",
+                    totals.GetKey(it.GetIndex()).c_str(),
+                    (unsigned long long)it->cycleCount,
+                    (unsigned long long)it->hitCount,
+                    (unsigned long long)(it->hitCount ? it->cycleCount / it->hitCount : 0));
+    }
+}
+
+void DebugLogMemoryCounters()
+{
+    DebugPrintf("--------< Memory Counters >----------------------------------------------------------------\n");
+#if !ENABLE_MEMORY_TRACKING
+    DebugPrintf("Memory tracking is disabled, operator new and pool pushes aren't counted\n");
+#endif
+
+    for (uint32_t tag = 0; tag < MemoryTag_Count; ++tag)
+    {
+        memory_tag_stats stats;
+        GetMemoryTagStats((memory_tag)tag, &stats);
+        DebugPrintf("%s: LiveBytes=%llu PeakBytes=%llu AllocationCount=%llu PoolBytes=%llu\n",
+                    GetMemoryTagName((memory_tag)tag),
+                    stats.LiveBytes,
+                    stats.PeakBytes,
+                    stats.NumAllocations,
+                    stats.PoolBytes);
+    }
+
+    DebugPrintf("ResidentBytes=%llu\n", Sys_GetProcessResidentBytes());
+}
+
+struct DebugTraceRecord
+{
+    uint64_t timeNanos;
+    const char *name;
+    int64_t value;
+    DebugTraceEventType type;
+};
+
+struct DebugTraceBuffer
+{
+    DebugTraceRecord events[DEBUG_TRACE_EVENTS_PER_THREAD];
+    std::atomic<uint64_t> numEvents;        // Only written by the owning thread
+    uint32_t threadId;
+    char threadName[32];
+    DebugTraceBuffer *next;
+};
+
+static std::atomic<bool> traceEnabled(false);
+static std::atomic<DebugTraceBuffer *> traceBuffers(nullptr);
+static std::atomic<uint32_t> nextTraceThreadId(0);
+static uint64_t traceStartNanos = 0;
+static thread_local DebugTraceBuffer *threadTraceBuffer = nullptr;
+static thread_local char threadTraceName[32] = {};
+
+static DebugTraceBuffer *GetThreadTraceBuffer()
+{
+    if (!threadTraceBuffer)
+    {
+        // Buffers are linked into a global list and kept until exit, the
+        // thread may be gone by the time the trace is saved
+        MEMORY_TAG_SCOPE(MemoryTag_Debug);
+        DebugTraceBuffer *buffer = new DebugTraceBuffer;
+        buffer->numEvents = 0;
+        buffer->threadId = nextTraceThreadId.fetch_add(1, std::memory_order_relaxed);
+        memcpy(buffer->threadName, threadTraceName, sizeof(buffer->threadName));
+        buffer->next = traceBuffers.load(std::memory_order_relaxed);
+        while (!traceBuffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+
+        threadTraceBuffer = buffer;
+    }
+
+    return threadTraceBuffer;
+}
+
+void DebugEnableTrace(bool enable)
+{
+    if (enable && traceStartNanos == 0)
+    {
+        traceStartNanos = HiPerformanceTimer::GetTicksNanos();
     }
+
+    traceEnabled.store(enable, std::memory_order_release);
+}
+
+void DebugTraceSetThreadName(const char *name)
+{
+    snprintf(threadTraceName, sizeof(threadTraceName), "%s", name);
+    if (threadTraceBuffer)
+    {
+        memcpy(threadTraceBuffer->threadName, threadTraceName, sizeof(threadTraceName));
+    }
+}
+
+void DebugTraceEvent(DebugTraceEventType type, const char *name, int64_t value)
+{
+    if (!traceEnabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    DebugTraceBuffer *buffer = GetThreadTraceBuffer();
+    const uint64_t eventIndex = buffer->numEvents.load(std::memory_order_relaxed);
+    DebugTraceRecord *record = &buffer->events[eventIndex % DEBUG_TRACE_EVENTS_PER_THREAD];
+    record->timeNanos = HiPerformanceTimer::GetTicksNanos();
+    record->name = name;
+    record->value = value;
+    record->type = type;
+    buffer->numEvents.store(eventIndex + 1, std::memory_order_release);
+}
+
+static void AppendTraceString(std::string *json, const char *str)
+{
+    json->push_back('"');
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            json->push_back('\\');
+        }
+
+        json->push_back((uint8_t)*str < 0x20 ? ' ' : *str);
+    }
+    json->push_back('"');
+}
+
+bool SaveDebugTraceToFile(const char *filename)
+{
+    MEMORY_TAG_SCOPE(MemoryTag_Debug);
+    static const char *eventPhase[] = { "B", "E", "i", "C" };
+    std::string json = "{\"traceEvents\":[\n";
+    bool isFirstEvent = true;
+    char eventBuffer[128];
+
+    for (DebugTraceBuffer *buffer = traceBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+    {
+        if (buffer->threadName[0])
+        {
+            snprintf(eventBuffer, sizeof(eventBuffer), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":",
+                     isFirstEvent ? "" : ",\n", buffer->threadId);
+            json += eventBuffer;
+            AppendTraceString(&json, buffer->threadName);
+            json += "}}";
+            isFirstEvent = false;
+        }
+
+        const uint64_t numEvents = buffer->numEvents.load(std::memory_order_acquire);
+        const uint64_t firstEvent = numEvents > DEBUG_TRACE_EVENTS_PER_THREAD ? numEvents - DEBUG_TRACE_EVENTS_PER_THREAD : 0;
+        for (uint64_t eventIndex = firstEvent; eventIndex < numEvents; ++eventIndex)
+        {
+            const DebugTraceRecord &record = buffer->events[eventIndex % DEBUG_TRACE_EVENTS_PER_THREAD];
+            const double timeMicros = (double)(int64_t)(record.timeNanos - traceStartNanos) / 1000.0;
+
+            snprintf(eventBuffer, sizeof(eventBuffer), "%s{\"ph\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":",
+                     isFirstEvent ? "" : ",\n", eventPhase[record.type], buffer->threadId, timeMicros);
+            json += eventBuffer;
+            AppendTraceString(&json, record.name ? record.name : "Unknown");
+
+            if (record.type == DebugTraceEvent_Instant || record.type == DebugTraceEvent_Counter)
+            {
+                snprintf(eventBuffer, sizeof(eventBuffer), "%s,\"args\":{\"value\":%lld}",
+                         record.type == DebugTraceEvent_Instant ? ",\"s\":\"t\"" : "", (long long)record.value);
+                json += eventBuffer;
+            }
+
+            json += "}";
+            isFirstEvent = false;
+        }
+    }
+
+    json += "\n]}\n";
+
+    SysFile traceFile(filename, FileOpen_WriteTruncate);
+    if (!traceFile.IsValid())
+    {
+        return false;
+    }
+
+    return traceFile.Write((const uint8_t *)json.data(), json.size()) == json.size();
 }
\ No newline at end of file
@@ -11,7 +11,7 @@ public:
     FatalException(const std::string &message);
     virtual ~FatalException() = default;
 
-    virtual const char *what() const final;
+    virtual const char *what() const noexcept final;
 
 private:
     std::string errorMessage;
@@ -52,3 +52,29 @@ struct ScoopedTimedBlock
 
 // Using DebugPrintf to print out information about all linked performance records.
 void DebugLogPerformanceCounters(const DebugPerformenceRecord *record);
+
+// Using DebugPrintf to print out live, peak and allocation counts for every memory tag.
+void DebugLogMemoryCounters();
+
+// Timeline of events per thread that can be saved as a Chrome trace_event file
+// (open it in chrome://tracing). Every thread writes to its own ring buffer
+// without locking, the oldest events are overwritten when a buffer is full.
+// Timed blocks are added to the timeline as well, under the same name.
+// Event names aren't copied and has to outlive the trace.
+#define DEBUG_TRACE_EVENTS_PER_THREAD   32768
+
+enum DebugTraceEventType
+{
+    DebugTraceEvent_Begin,
+    DebugTraceEvent_End,
+    DebugTraceEvent_Instant,
+    DebugTraceEvent_Counter
+};
+
+void DebugEnableTrace(bool enable);
+void DebugTraceSetThreadName(const char *name);
+void DebugTraceEvent(DebugTraceEventType type, const char *name, int64_t value = 0);
+
+// Save the events recorded so far, should be called while no other thread
+// is adding events.
+bool SaveDebugTraceToFile(const char *filename);
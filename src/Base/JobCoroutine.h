@@ -0,0 +1,190 @@
+#pragma once
+#include "Base/ParallelJobQueue.h"
+#include "Base/File.h"
+
+// C++20 coroutine support for the job queue. A job_task runs on the job
+// queue and can co_await job counters and file reads, while it waits the
+// coroutine doesn't occupy a worker thread. After a wait the coroutine is
+// resubmitted as a job at the priority it was running at.
+//
+// Only compiled with a toolset that implements coroutines, the v140 project
+// and the C++14 engine core don't. CMake builds and runs
+// src/Tests/JobCoroutineTest.cpp as C++20 where the compiler supports it.
+//
+// Usage example:
+//  job_task LoadTextureTask(parallel_job_queue *Queue, const char *Filename, Image *OutImage)
+//  {
+//      std::vector<uint8_t> FileBuffer;
+//      if (!co_await ReadFileInBackgroundJob(Queue, Filename, &FileBuffer))
+//          co_return;
+//
+//      job_counter DecodeCounter;
+//      SubmitJob(Queue, DecodeMipLevelsJob, OutImage, &DecodeCounter);
+//      co_await WaitForCounterAsync(Queue, &DecodeCounter);
+//  }
+//
+//  job_counter Counter;
+//  SubmitJobTask(Queue, LoadTextureTask(Queue, "assets/cursor.png", &Image), &Counter);
+//  WaitForCounter(Queue, &Counter);
+//
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#define JOB_COROUTINES_SUPPORTED 1
+#include <coroutine>
+
+class job_task
+{
+public:
+    struct promise_type
+    {
+        parallel_job_queue *Queue = nullptr;
+        job_counter *Counter = nullptr;
+
+        job_task get_return_object() { return job_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        // The frame is destroyed when the coroutine runs to the end, the
+        // counter is released first so waiters see the task as finished
+        std::suspend_never final_suspend() noexcept
+        {
+            if (Counter)
+            {
+                DecrementJobCounter(Queue, Counter);
+            }
+
+            return {};
+        }
+    };
+
+    job_task(job_task &&Other) noexcept : Handle(Other.Handle) { Other.Handle = nullptr; }
+    job_task(const job_task &) = delete;
+    job_task &operator=(const job_task &) = delete;
+
+    ~job_task()
+    {
+        // Destroy tasks that never got submitted
+        if (Handle)
+        {
+            Handle.destroy();
+        }
+    }
+
+private:
+    explicit job_task(std::coroutine_handle<promise_type> InHandle) : Handle(InHandle) {}
+
+    friend void SubmitJobTask(parallel_job_queue *Queue, job_task Task, job_counter *Counter, job_priority Priority);
+    std::coroutine_handle<promise_type> Handle;
+};
+
+inline void ResumeCoroutineJob(void *Data)
+{
+    std::coroutine_handle<>::from_address(Data).resume();
+}
+
+// Start Task on Queue. Counter is released when the task has run to the
+// end, not when it first suspends.
+inline void SubmitJobTask(parallel_job_queue *Queue, job_task Task, job_counter *Counter = nullptr, job_priority Priority = JobPriority_Normal)
+{
+    job_task::promise_type &Promise = Task.Handle.promise();
+    Promise.Queue = Queue;
+    Promise.Counter = Counter;
+    if (Counter)
+    {
+        IncrementJobCounter(Counter);
+    }
+
+    SubmitNamedJob(Queue, "JobTask", ResumeCoroutineJob, Task.Handle.address(), nullptr, Priority);
+    Task.Handle = nullptr;
+}
+
+struct job_counter_awaiter
+{
+    parallel_job_queue *Queue;
+    job_counter *Counter;
+    job_counter_waiter Waiter;
+
+    // The counter may live in the coroutine frame, so wait until the
+    // decrementing thread is done with it before running on
+    bool await_ready() const
+    {
+        return IsJobCounterDone(Counter);
+    }
+
+    bool await_suspend(std::coroutine_handle<> Handle)
+    {
+        Waiter.Entry.Callback = ResumeCoroutineJob;
+        Waiter.Entry.Data = Handle.address();
+        Waiter.Entry.Counter = nullptr;
+        Waiter.Entry.Priority = GetCurrentJobPriority();
+        Waiter.Entry.Name = "JobTask";
+        Waiter.Queue = Queue;
+        Waiter.Next = nullptr;
+
+        // Keep running if the counter reached zero while registering
+        return AddJobCounterWaiter(Counter, &Waiter);
+    }
+
+    void await_resume() {}
+};
+
+// Suspend the calling coroutine until Counter reaches zero, the coroutine
+// is resumed as a new job on Queue.
+inline job_counter_awaiter WaitForCounterAsync(parallel_job_queue *Queue, job_counter *Counter)
+{
+    return job_counter_awaiter{ Queue, Counter, {} };
+}
+
+struct job_file_read_awaiter
+{
+    parallel_job_queue *Queue;
+    const char *Filename;
+    std::vector<uint8_t> *OutBuffer;
+    bool Succeeded;
+    std::coroutine_handle<> Handle;
+    job_priority Priority;
+
+    static void ReadFileJob(void *Data)
+    {
+        job_file_read_awaiter *Awaiter = (job_file_read_awaiter *)Data;
+
+        SysFile File(Awaiter->Filename, FileOpen_Read);
+        Awaiter->Succeeded = File.IsValid();
+        if (Awaiter->Succeeded)
+        {
+            const size_t Length = File.GetLength();
+            Awaiter->OutBuffer->resize(Length);
+            Awaiter->Succeeded = (File.Read(Awaiter->OutBuffer->data(), Length) == Length);
+        }
+
+        // Continue the coroutine as a job at its own priority, so decoding
+        // and uploading after the read don't hold a background slot. The
+        // awaiter lives in the coroutine frame, it can't be touched once the
+        // coroutine is submitted.
+        SubmitNamedJob(Awaiter->Queue, "JobTask", ResumeCoroutineJob, Awaiter->Handle.address(), nullptr, Awaiter->Priority);
+    }
+
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> InHandle)
+    {
+        Handle = InHandle;
+        Priority = GetCurrentJobPriority();
+        SubmitNamedJob(Queue, "ReadFile", ReadFileJob, this, nullptr, JobPriority_Background);
+    }
+
+    bool await_resume() const { return Succeeded; }
+};
+
+// Read a whole file into OutBuffer from a background job, resumes with false
+// if the file couldn't be read. The read is a blocking SysFile read, it
+// frees the calling worker but occupies a background worker for the whole
+// read. Background jobs are capped below the worker count, so reads never
+// starve frame critical jobs. The coroutine continues as a new job at the
+// priority it was running at before the read.
+inline job_file_read_awaiter ReadFileInBackgroundJob(parallel_job_queue *Queue, const char *Filename, std::vector<uint8_t> *OutBuffer)
+{
+    return job_file_read_awaiter{ Queue, Filename, OutBuffer, false, nullptr, JobPriority_Normal };
+}
+
+#endif // __cpp_impl_coroutine
\ No newline at end of file
@@ -0,0 +1,643 @@
+#include "Precompiled.h"
+#include "Base/Memory.h"
+#include "Base/Debug.h"
+#include "Base/Sys.h"
+#include <atomic>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//
+// Memory tracking
+//
+
+static const char *MemoryTagNames[MemoryTag_Count] =
+{
+    "Untagged",
+    "Renderer",
+    "Textures",
+    "OBJ",
+    "Debug"
+};
+
+// Zero initialized before any constructor runs, operator new may be called
+// during static initialization
+static std::atomic<uint64_t> TagLiveBytes[MemoryTag_Count];
+static std::atomic<uint64_t> TagPeakBytes[MemoryTag_Count];
+static std::atomic<uint64_t> TagNumAllocations[MemoryTag_Count];
+static std::atomic<uint64_t> TagPoolBytes[MemoryTag_Count];
+static std::atomic<uint32_t> FrameAllocationCount;
+static thread_local memory_tag CurrentMemoryTag = MemoryTag_Untagged;
+
+const char *GetMemoryTagName(memory_tag Tag)
+{
+    assert(Tag < MemoryTag_Count);
+    return MemoryTagNames[Tag];
+}
+
+memory_tag GetCurrentMemoryTag()
+{
+    return CurrentMemoryTag;
+}
+
+void SetCurrentMemoryTag(memory_tag Tag)
+{
+    assert(Tag < MemoryTag_Count);
+    CurrentMemoryTag = Tag;
+}
+
+void GetMemoryTagStats(memory_tag Tag, memory_tag_stats *Stats)
+{
+    assert(Tag < MemoryTag_Count);
+    Stats->LiveBytes = TagLiveBytes[Tag].load(std::memory_order_relaxed);
+    Stats->PeakBytes = TagPeakBytes[Tag].load(std::memory_order_relaxed);
+    Stats->NumAllocations = TagNumAllocations[Tag].load(std::memory_order_relaxed);
+    Stats->PoolBytes = TagPoolBytes[Tag].load(std::memory_order_relaxed);
+}
+
+memory_tag TrackAllocation(uint64_t Size)
+{
+    const memory_tag Tag = CurrentMemoryTag;
+    const uint64_t LiveBytes = TagLiveBytes[Tag].fetch_add(Size, std::memory_order_relaxed) + Size;
+    uint64_t PeakBytes = TagPeakBytes[Tag].load(std::memory_order_relaxed);
+    while (LiveBytes > PeakBytes && !TagPeakBytes[Tag].compare_exchange_weak(PeakBytes, LiveBytes, std::memory_order_relaxed))
+    {
+    }
+
+    TagNumAllocations[Tag].fetch_add(1, std::memory_order_relaxed);
+    FrameAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return Tag;
+}
+
+void TrackFree(memory_tag Tag, uint64_t Size)
+{
+    assert(Tag < MemoryTag_Count);
+    TagLiveBytes[Tag].fetch_sub(Size, std::memory_order_relaxed);
+}
+
+void TrackPoolAllocation(uint64_t Size)
+{
+    TagPoolBytes[CurrentMemoryTag].fetch_add(Size, std::memory_order_relaxed);
+}
+
+uint32_t GetAndResetFrameAllocationCount()
+{
+    return FrameAllocationCount.exchange(0, std::memory_order_relaxed);
+}
+
+// Kept in front of every tracked heap allocation, 16 bytes so the memory
+// returned keeps malloc's alignment
+struct tracked_allocation_header
+{
+    uint64_t Size;
+    uint32_t Tag;
+    uint32_t Magic;
+};
+
+#define TRACKED_ALLOCATION_MAGIC    0x4d454d54
+
+void *TrackedMalloc(size_t Size)
+{
+    tracked_allocation_header *Header = (tracked_allocation_header *)malloc(sizeof(tracked_allocation_header) + Size);
+    if (!Header)
+    {
+        return nullptr;
+    }
+
+    Header->Size = Size;
+    Header->Tag = TrackAllocation(Size);
+    Header->Magic = TRACKED_ALLOCATION_MAGIC;
+    return Header + 1;
+}
+
+void *TrackedRealloc(void *Memory, size_t Size)
+{
+    if (!Memory)
+    {
+        return TrackedMalloc(Size);
+    }
+
+    void *Result = TrackedMalloc(Size);
+    if (Result)
+    {
+        const tracked_allocation_header *Header = (const tracked_allocation_header *)Memory - 1;
+        memcpy(Result, Memory, Header->Size < Size ? (size_t)Header->Size : Size);
+        TrackedFree(Memory);
+    }
+
+    return Result;
+}
+
+void TrackedFree(void *Memory)
+{
+    if (!Memory)
+    {
+        return;
+    }
+
+    tracked_allocation_header *Header = (tracked_allocation_header *)Memory - 1;
+    assert(Header->Magic == TRACKED_ALLOCATION_MAGIC && "Memory wasn't allocated by TrackedMalloc");
+    TrackFree((memory_tag)Header->Tag, Header->Size);
+    Header->Magic = 0;
+    free(Header);
+}
+
+#if ENABLE_MEMORY_TRACKING
+void *operator new(size_t Size)
+{
+    void *Memory = TrackedMalloc(Size);
+    if (!Memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return Memory;
+}
+
+void *operator new[](size_t Size)
+{
+    return operator new(Size);
+}
+
+void *operator new(size_t Size, const std::nothrow_t &) noexcept
+{
+    return TrackedMalloc(Size);
+}
+
+void *operator new[](size_t Size, const std::nothrow_t &) noexcept
+{
+    return TrackedMalloc(Size);
+}
+
+void operator delete(void *Memory) noexcept
+{
+    TrackedFree(Memory);
+}
+
+void operator delete[](void *Memory) noexcept
+{
+    TrackedFree(Memory);
+}
+
+void operator delete(void *Memory, size_t) noexcept
+{
+    TrackedFree(Memory);
+}
+
+void operator delete[](void *Memory, size_t) noexcept
+{
+    TrackedFree(Memory);
+}
+
+void operator delete(void *Memory, const std::nothrow_t &) noexcept
+{
+    TrackedFree(Memory);
+}
+
+void operator delete[](void *Memory, const std::nothrow_t &) noexcept
+{
+    TrackedFree(Memory);
+}
+#endif
+
+//
+// Memory pools
+//
+
+void CommitMemoryPool(memory_pool *Pool, memory_index Offset)
+{
+    assert(Pool->CommitGranularity > 0);
+
+    // Commit whole steps of CommitGranularity, aligned to the address so
+    // huge pages are filled completely. A range skipped with
+    // MemoryAllocation_NoCommit is left for its sub pool.
+    const uintptr_t GranularityMask = (uintptr_t)Pool->CommitGranularity - 1;
+    uintptr_t Start = ((uintptr_t)Pool->Base + Offset) & ~GranularityMask;
+    uintptr_t End = ((uintptr_t)Pool->Base + Pool->Used + GranularityMask) & ~GranularityMask;
+    if (Start < (uintptr_t)Pool->Base + Pool->Committed)
+    {
+        Start = (uintptr_t)Pool->Base + Pool->Committed;
+    }
+
+    if (End > (uintptr_t)Pool->Base + Pool->Size)
+    {
+        End = (uintptr_t)Pool->Base + Pool->Size;
+    }
+
+    if (!Sys_Commit((void *)Start, End - Start))
+    {
+        assert(!"Failed to commit memory pool");
+    }
+
+    Pool->Committed = End - (uintptr_t)Pool->Base;
+}
+
+//
+// Scratch memory
+//
+
+static memory_pool *ScratchPools = nullptr;
+static uint32_t MaxScratchThreads = 0;
+static std::atomic<uint32_t> NumScratchThreads(0);
+
+// Bumped on every (re)initialization so threads don't hold on to pools from
+// a previous block of scratch memory
+static std::atomic<uint32_t> ScratchGeneration(0);
+static thread_local memory_pool *ThreadScratchPool = nullptr;
+static thread_local uint32_t ThreadScratchGeneration = 0;
+
+void InitializeScratchMemory(memory_pool *Pool, memory_index Size, uint32_t MaxThreads)
+{
+    assert(MaxThreads > 0);
+    assert(CanPushSize(Pool, Size));
+
+    // Pool headers go in front, the rest is split into equal slices
+    const memory_index HeaderSize = MaxThreads * sizeof(memory_pool) + 16;
+    ScratchPools = PushArray(Pool, MaxThreads, memory_pool, MemoryAllocation_Align16);
+
+    const memory_index SliceSize = ((Size - HeaderSize) / MaxThreads) & ~(memory_index)63;
+    assert(SliceSize > 0);
+    for (uint32_t ThreadIndex = 0; ThreadIndex < MaxThreads; ++ThreadIndex)
+    {
+        InitializeSubPool(&ScratchPools[ThreadIndex], Pool, SliceSize);
+    }
+
+    MaxScratchThreads = MaxThreads;
+    NumScratchThreads = 0;
+    ScratchGeneration.fetch_add(1, std::memory_order_release);
+}
+
+void DestroyScratchMemory()
+{
+    // More threads than pools may have asked for one
+    const uint32_t NumUsedPools = NumScratchThreads < MaxScratchThreads ? (uint32_t)NumScratchThreads : MaxScratchThreads;
+    for (uint32_t ThreadIndex = 0; ThreadIndex < NumUsedPools; ++ThreadIndex)
+    {
+        CheckMemoryPool(&ScratchPools[ThreadIndex]);
+    }
+
+    ScratchPools = nullptr;
+    MaxScratchThreads = 0;
+    NumScratchThreads = 0;
+    ScratchGeneration.fetch_add(1, std::memory_order_release);
+}
+
+memory_pool *GetThreadScratchPool()
+{
+    const uint32_t Generation = ScratchGeneration.load(std::memory_order_acquire);
+    if (ThreadScratchGeneration != Generation)
+    {
+        ThreadScratchPool = nullptr;
+        ThreadScratchGeneration = Generation;
+
+        const uint32_t PoolIndex = NumScratchThreads.fetch_add(1, std::memory_order_relaxed);
+        if (ScratchPools && PoolIndex < MaxScratchThreads)
+        {
+            ThreadScratchPool = &ScratchPools[PoolIndex];
+        }
+    }
+
+    return ThreadScratchPool;
+}
+
+//
+// Block pool
+//
+static std::atomic<uint32_t> NumBlockPoolThreads(0);
+
+uint32_t GetBlockPoolThreadSlot()
+{
+    static thread_local uint32_t ThreadSlot = NumBlockPoolThreads.fetch_add(1, std::memory_order_relaxed);
+    return ThreadSlot;
+}
+
+//
+// TLSF heap
+//
+
+#define TLSF_BLOCK_FREE             1
+#define TLSF_BLOCK_HEADER_SIZE      offsetof(tlsf_block, NextFree)
+#define TLSF_MIN_BLOCK_SIZE         (sizeof(tlsf_block) - TLSF_BLOCK_HEADER_SIZE)
+#define TLSF_SMALL_BLOCK_SIZE       ((memory_index)1 << TLSF_FL_SHIFT)
+
+struct tlsf_block
+{
+    // Previous block in memory, nullptr for the first block
+    tlsf_block *PrevPhysical;
+
+    // Size of the memory following the header, the lowest bit is set while
+    // the block is free
+    memory_index Size;
+
+    // Only used by free blocks, overlaps the allocated memory. Aligned so
+    // the header is padded to TLSF_ALIGNMENT on 32 bit too, memory handed
+    // out starts here.
+    alignas(TLSF_ALIGNMENT) tlsf_block *NextFree;
+    tlsf_block *PrevFree;
+};
+
+static_assert(TLSF_BLOCK_HEADER_SIZE % TLSF_ALIGNMENT == 0, "TLSF block header has to keep allocations aligned");
+
+static uint32_t FindFirstSet(uint32_t Word)
+{
+    assert(Word != 0);
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanForward(&Index, Word);
+    return Index;
+#else
+    return __builtin_ctz(Word);
+#endif
+}
+
+static uint32_t FindLastSet(uint64_t Value)
+{
+    assert(Value != 0);
+#if defined(_MSC_VER)
+    unsigned long Index;
+    if (Value >> 32)
+    {
+        _BitScanReverse(&Index, (uint32_t)(Value >> 32));
+        return Index + 32;
+    }
+
+    _BitScanReverse(&Index, (uint32_t)Value);
+    return Index;
+#else
+    return 63 - __builtin_clzll(Value);
+#endif
+}
+
+static memory_index GetBlockSize(const tlsf_block *Block)
+{
+    return Block->Size & ~(memory_index)TLSF_BLOCK_FREE;
+}
+
+static bool IsBlockFree(const tlsf_block *Block)
+{
+    return (Block->Size & TLSF_BLOCK_FREE) != 0;
+}
+
+static tlsf_block *GetNextPhysicalBlock(const tlsf_block *Block)
+{
+    return (tlsf_block *)((uint8_t *)Block + TLSF_BLOCK_HEADER_SIZE + GetBlockSize(Block));
+}
+
+static void MappingInsert(memory_index Size, uint32_t *Fl, uint32_t *Sl)
+{
+    if (Size < TLSF_SMALL_BLOCK_SIZE)
+    {
+        // Small blocks are linearly spaced in the first list
+        *Fl = 0;
+        *Sl = (uint32_t)(Size / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_COUNT));
+    }
+    else
+    {
+        const uint32_t LastSet = FindLastSet(Size);
+        *Sl = (uint32_t)(Size >> (LastSet - TLSF_SL_INDEX_COUNT_LOG2)) ^ TLSF_SL_COUNT;
+        *Fl = LastSet - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+// Round the size up to the next size class, so any block in the class is
+// large enough.
+static void MappingSearch(memory_index Size, uint32_t *Fl, uint32_t *Sl)
+{
+    if (Size >= TLSF_SMALL_BLOCK_SIZE)
+    {
+        Size += ((memory_index)1 << (FindLastSet(Size) - TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+    }
+
+    MappingInsert(Size, Fl, Sl);
+}
+
+static void InsertFreeBlock(tlsf_heap *Heap, tlsf_block *Block)
+{
+    uint32_t Fl, Sl;
+    MappingInsert(GetBlockSize(Block), &Fl, &Sl);
+
+    tlsf_block *Head = Heap->FreeBlocks[Fl][Sl];
+    Block->NextFree = Head;
+    Block->PrevFree = nullptr;
+    if (Head)
+    {
+        Head->PrevFree = Block;
+    }
+
+    Heap->FreeBlocks[Fl][Sl] = Block;
+    Heap->FlBitmap |= 1u << Fl;
+    Heap->SlBitmap[Fl] |= 1u << Sl;
+}
+
+static void RemoveFreeBlock(tlsf_heap *Heap, tlsf_block *Block)
+{
+    uint32_t Fl, Sl;
+    MappingInsert(GetBlockSize(Block), &Fl, &Sl);
+
+    if (Block->NextFree)
+    {
+        Block->NextFree->PrevFree = Block->PrevFree;
+    }
+
+    if (Block->PrevFree)
+    {
+        Block->PrevFree->NextFree = Block->NextFree;
+    }
+    else
+    {
+        assert(Heap->FreeBlocks[Fl][Sl] == Block);
+        Heap->FreeBlocks[Fl][Sl] = Block->NextFree;
+        if (!Block->NextFree)
+        {
+            Heap->SlBitmap[Fl] &= ~(1u << Sl);
+            if (!Heap->SlBitmap[Fl])
+            {
+                Heap->FlBitmap &= ~(1u << Fl);
+            }
+        }
+    }
+}
+
+static tlsf_block *FindFreeBlock(tlsf_heap *Heap, memory_index Size)
+{
+    uint32_t Fl, Sl;
+    MappingSearch(Size, &Fl, &Sl);
+    if (Fl >= TLSF_FL_COUNT)
+    {
+        return nullptr;
+    }
+
+    // First try the remaining size classes in the same list, then the
+    // smallest non empty list above it
+    uint32_t SlMap = Heap->SlBitmap[Fl] & (~0u << Sl);
+    if (!SlMap)
+    {
+        const uint32_t FlMap = (Fl + 1 < TLSF_FL_COUNT) ? Heap->FlBitmap & (~0u << (Fl + 1)) : 0;
+        if (!FlMap)
+        {
+            return nullptr;
+        }
+
+        Fl = FindFirstSet(FlMap);
+        SlMap = Heap->SlBitmap[Fl];
+    }
+
+    Sl = FindFirstSet(SlMap);
+    return Heap->FreeBlocks[Fl][Sl];
+}
+
+void InitializeTlsfHeap(tlsf_heap *Heap, void *Base, memory_index Size)
+{
+    const memory_index AlignmentOffset = (TLSF_ALIGNMENT - ((memory_index)Base & (TLSF_ALIGNMENT - 1))) & (TLSF_ALIGNMENT - 1);
+    Heap->Base = (uint8_t *)Base + AlignmentOffset;
+    Heap->Size = (Size - AlignmentOffset) & ~(memory_index)(TLSF_ALIGNMENT - 1);
+    Heap->Used = 0;
+    Heap->PeakUsed = 0;
+    Heap->NumAllocations = 0;
+    Heap->FlBitmap = 0;
+    memset(Heap->SlBitmap, 0, sizeof(Heap->SlBitmap));
+    memset(Heap->FreeBlocks, 0, sizeof(Heap->FreeBlocks));
+
+    // One free block covering the heap, followed by an empty block that is
+    // never free so merging stops at the end
+    assert(Heap->Size >= 2 * TLSF_BLOCK_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE);
+    const memory_index BlockSize = Heap->Size - 2 * TLSF_BLOCK_HEADER_SIZE;
+    assert(BlockSize < ((memory_index)1 << TLSF_FL_INDEX_MAX));
+
+    tlsf_block *Block = (tlsf_block *)Heap->Base;
+    Block->PrevPhysical = nullptr;
+    Block->Size = BlockSize | TLSF_BLOCK_FREE;
+
+    tlsf_block *Sentinel = GetNextPhysicalBlock(Block);
+    Sentinel->PrevPhysical = Block;
+    Sentinel->Size = 0;
+
+    InsertFreeBlock(Heap, Block);
+}
+
+void *TlsfAlloc(tlsf_heap *Heap, memory_index Size)
+{
+    Size = (Size + (TLSF_ALIGNMENT - 1)) & ~(memory_index)(TLSF_ALIGNMENT - 1);
+    if (Size < TLSF_MIN_BLOCK_SIZE)
+    {
+        Size = TLSF_MIN_BLOCK_SIZE;
+    }
+
+    std::lock_guard<std::mutex> Guard(Heap->Lock);
+    tlsf_block *Block = FindFreeBlock(Heap, Size);
+    if (!Block)
+    {
+        return nullptr;
+    }
+
+    RemoveFreeBlock(Heap, Block);
+
+    // Give the tail back if it's large enough to be a block of its own
+    const memory_index BlockSize = GetBlockSize(Block);
+    if (BlockSize >= Size + TLSF_BLOCK_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE)
+    {
+        tlsf_block *Remainder = (tlsf_block *)((uint8_t *)Block + TLSF_BLOCK_HEADER_SIZE + Size);
+        Remainder->PrevPhysical = Block;
+        Remainder->Size = (BlockSize - Size - TLSF_BLOCK_HEADER_SIZE) | TLSF_BLOCK_FREE;
+        GetNextPhysicalBlock(Remainder)->PrevPhysical = Remainder;
+        InsertFreeBlock(Heap, Remainder);
+        Block->Size = Size;
+    }
+    else
+    {
+        Block->Size = BlockSize;
+    }
+
+    Heap->Used += GetBlockSize(Block);
+    if (Heap->Used > Heap->PeakUsed)
+    {
+        Heap->PeakUsed = Heap->Used;
+    }
+
+    ++Heap->NumAllocations;
+    return (uint8_t *)Block + TLSF_BLOCK_HEADER_SIZE;
+}
+
+void TlsfFree(tlsf_heap *Heap, void *Memory)
+{
+    if (!Memory)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> Guard(Heap->Lock);
+    tlsf_block *Block = (tlsf_block *)((uint8_t *)Memory - TLSF_BLOCK_HEADER_SIZE);
+    assert(!IsBlockFree(Block) && "Memory freed twice");
+    assert((uint8_t *)Block >= Heap->Base && (uint8_t *)Block < Heap->Base + Heap->Size);
+
+    Heap->Used -= GetBlockSize(Block);
+    --Heap->NumAllocations;
+
+    // Merge with free neighbours
+    tlsf_block *Prev = Block->PrevPhysical;
+    if (Prev && IsBlockFree(Prev))
+    {
+        RemoveFreeBlock(Heap, Prev);
+        Prev->Size += TLSF_BLOCK_HEADER_SIZE + GetBlockSize(Block);
+        Block = Prev;
+    }
+
+    tlsf_block *Next = GetNextPhysicalBlock(Block);
+    if (IsBlockFree(Next))
+    {
+        RemoveFreeBlock(Heap, Next);
+        Block->Size = GetBlockSize(Block) + TLSF_BLOCK_HEADER_SIZE + GetBlockSize(Next);
+    }
+
+    Block->Size = GetBlockSize(Block) | TLSF_BLOCK_FREE;
+    GetNextPhysicalBlock(Block)->PrevPhysical = Block;
+    InsertFreeBlock(Heap, Block);
+}
+
+void GetTlsfHeapStats(tlsf_heap *Heap, tlsf_heap_stats *Stats)
+{
+    std::lock_guard<std::mutex> Guard(Heap->Lock);
+    *Stats = {};
+    Stats->Size = Heap->Size;
+    Stats->Used = Heap->Used;
+    Stats->PeakUsed = Heap->PeakUsed;
+
+    // The sentinel is the only empty block that isn't free
+    for (tlsf_block *Block = (tlsf_block *)Heap->Base; Block->Size != 0; Block = GetNextPhysicalBlock(Block))
+    {
+        const memory_index BlockSize = GetBlockSize(Block);
+        if (IsBlockFree(Block))
+        {
+            Stats->Free += BlockSize;
+            ++Stats->NumFreeBlocks;
+            if (BlockSize > Stats->LargestFreeBlock)
+            {
+                Stats->LargestFreeBlock = BlockSize;
+            }
+        }
+        else
+        {
+            ++Stats->NumUsedBlocks;
+        }
+    }
+
+    Stats->Fragmentation = Stats->Free ? 1.0f - (float)Stats->LargestFreeBlock / (float)Stats->Free : 0.0f;
+}
+
+void DebugLogTlsfHeap(tlsf_heap *Heap, const char *Name)
+{
+    tlsf_heap_stats Stats;
+    GetTlsfHeapStats(Heap, &Stats);
+
+    DebugPrintf("--------< TLSF Heap: %s >-----------------------------------------------------------\n", Name);
+    DebugPrintf("Size=%llu Used=%llu PeakUsed=%llu Free=%llu LargestFreeBlock=%llu\n",
+                (unsigned long long)Stats.Size,
+                (unsigned long long)Stats.Used,
+                (unsigned long long)Stats.PeakUsed,
+                (unsigned long long)Stats.Free,
+                (unsigned long long)Stats.LargestFreeBlock);
+    DebugPrintf("UsedBlocks=%u FreeBlocks=%u Fragmentation=%.1f%%\n",
+                Stats.NumUsedBlocks,
+                Stats.NumFreeBlocks,
+                Stats.Fragmentation * 100.0f);
+}
\ No newline at end of file
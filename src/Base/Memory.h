@@ -1,6 +1,18 @@
 #pragma once
 #include <stdint.h>
 #include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <string.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MEMORY_HAS_SSE2                 1
+#else
+#define MEMORY_HAS_SSE2                 0
+#endif
 
 #define Kilobytes(value)                (value*UINT64_C(1024))
 #define Megabytes(value)                (Kilobytes(value)*UINT64_C(1024))
@@ -16,12 +28,94 @@ enum memory_allocation_flags
     MemoryAllocation_AlignMask  = 0x0f,
     MemoryAllocation_Clear      = 0x10,
     MemoryAllocation_ClearMask  = 0xf0,
+    MemoryAllocation_NoCommit   = 0x100,        // Only reserve the range in a pool that commits on demand
 
-    MemoryAllocation_Default    = MemoryAllocation_Align4 | MemoryAllocation_Clear
+    MemoryAllocation_Default    = MemoryAllocation_Align4
 };
 
+// Clears this large bypass the cache, the cleared memory would evict
+// everything else and its start is out of the cache again by the time the
+// clear is done. Below it memset wins even on memory that isn't cached,
+// because the caller reads the block right after, see the "clear strategy"
+// benchmarks in CybBench.
+#define CLEAR_MEMORY_NON_TEMPORAL_SIZE  Megabytes(4)
+
 typedef size_t memory_index;
 
+//
+// Memory tracking
+//
+
+// Count heap allocations (operator new, TrackedMalloc and Sys_Alloc) and
+// memory pool pushes by the memory tag of the allocating thread. Replaces
+// the global operator new, so it's only on in debug builds by default. The
+// x64 release configuration doesn't define NDEBUG, check _DEBUG on MSVC.
+#ifndef ENABLE_MEMORY_TRACKING
+#if defined(_DEBUG) || (!defined(_MSC_VER) && !defined(NDEBUG))
+#define ENABLE_MEMORY_TRACKING          1
+#else
+#define ENABLE_MEMORY_TRACKING          0
+#endif
+#endif
+
+enum memory_tag
+{
+    MemoryTag_Untagged,
+    MemoryTag_Renderer,
+    MemoryTag_Textures,
+    MemoryTag_OBJ,
+    MemoryTag_Debug,
+    MemoryTag_Count
+};
+
+struct memory_tag_stats
+{
+    uint64_t LiveBytes;
+    uint64_t PeakBytes;
+    uint64_t NumAllocations;        // Including the ones already freed
+    uint64_t PoolBytes;             // Pushed to memory pools, released in bulk so never live
+};
+
+const char *GetMemoryTagName(memory_tag Tag);
+memory_tag GetCurrentMemoryTag();
+void SetCurrentMemoryTag(memory_tag Tag);
+void GetMemoryTagStats(memory_tag Tag, memory_tag_stats *Stats);
+
+// Count an allocation under the current tag and return the tag, which has
+// to be passed to TrackFree when the memory is released.
+memory_tag TrackAllocation(uint64_t Size);
+void TrackFree(memory_tag Tag, uint64_t Size);
+void TrackPoolAllocation(uint64_t Size);
+
+// Heap allocations made by any thread since the last call.
+uint32_t GetAndResetFrameAllocationCount();
+
+// malloc compatible functions that are tracked like operator new, for
+// libraries that take custom allocation functions.
+void *TrackedMalloc(size_t Size);
+void *TrackedRealloc(void *Memory, size_t Size);
+void TrackedFree(void *Memory);
+
+// Tag every allocation on this thread until the end of the scope.
+//
+// Usage example:
+//  {
+//      MEMORY_TAG_SCOPE(MemoryTag_OBJ);
+//      auto rawModel = OBJ_LoadModel(filename);
+//  }
+//
+struct scoped_memory_tag
+{
+    memory_tag PreviousTag;
+
+    scoped_memory_tag(memory_tag Tag) : PreviousTag(GetCurrentMemoryTag()) { SetCurrentMemoryTag(Tag); }
+    ~scoped_memory_tag() { SetCurrentMemoryTag(PreviousTag); }
+};
+
+#define MEMORY_TAG_SCOPE__(num, tag)    scoped_memory_tag scopedMemoryTag_##num(tag)
+#define MEMORY_TAG_SCOPE_(num, tag)     MEMORY_TAG_SCOPE__(num, tag)
+#define MEMORY_TAG_SCOPE(tag)           MEMORY_TAG_SCOPE_(__LINE__, tag)
+
 struct memory_pool
 {
     memory_index Size;
@@ -29,39 +123,100 @@ struct memory_pool
     memory_index Used;
 
     int32_t TempCount;
+
+    // Highest committed offset, pools over reserved memory start at zero
+    // and commit CommitGranularity sized steps as they grow. Ranges pushed
+    // with MemoryAllocation_NoCommit below it are committed by their sub
+    // pools.
+    memory_index Committed;
+    memory_index CommitGranularity;
+
+    // Memory from DirtySize to the end of the pool is known to be zero, it
+    // has never been pushed since it came from the OS. Clearing pushes only
+    // clear what's below it.
+    memory_index DirtySize;
 };
 
-struct temporaty_memory
+struct temporary_memory
 {
     memory_pool *Pool;
     memory_index Used;
 };
 
-inline void ClearMemory(void *Address, memory_index Length)
+inline void ClearMemoryNonTemporal(void *Address, memory_index Length)
 {
-#if 0
-    // TODO: Check performance
-    uint8_t *byte = (uint8_t *)ptr;
-    while (size--)
+#if MEMORY_HAS_SSE2
+    // Plain stores up to the first and from the last 64 byte boundary,
+    // streaming stores in between
+    uint8_t *Start = (uint8_t *)Address;
+    uint8_t *End = Start + Length;
+    uint8_t *StreamStart = (uint8_t *)(((uintptr_t)Start + 63) & ~(uintptr_t)63);
+    uint8_t *StreamEnd = (uint8_t *)((uintptr_t)End & ~(uintptr_t)63);
+    if (StreamStart >= StreamEnd)
     {
-        *byte++ = 0;
+        memset(Address, 0, Length);
+        return;
     }
+
+    memset(Start, 0, StreamStart - Start);
+    const __m128i Zero = _mm_setzero_si128();
+    for (uint8_t *Line = StreamStart; Line < StreamEnd; Line += 64)
+    {
+        _mm_stream_si128((__m128i *)(Line +  0), Zero);
+        _mm_stream_si128((__m128i *)(Line + 16), Zero);
+        _mm_stream_si128((__m128i *)(Line + 32), Zero);
+        _mm_stream_si128((__m128i *)(Line + 48), Zero);
+    }
+
+    // Streaming stores are weakly ordered, make them visible before the
+    // memory is handed out
+    _mm_sfence();
+    memset(StreamEnd, 0, End - StreamEnd);
 #else
     memset(Address, 0, Length);
 #endif
 }
 
+inline void ClearMemory(void *Address, memory_index Length)
+{
+    if (Length >= CLEAR_MEMORY_NON_TEMPORAL_SIZE)
+    {
+        ClearMemoryNonTemporal(Address, Length);
+    }
+    else
+    {
+        memset(Address, 0, Length);
+    }
+}
+
 inline void InitializeMemoryPool(memory_pool *Pool, memory_index Size, void *Base)
 {
     assert(Size > 0);
-    assert(Base > 0);
+    assert(Base != nullptr);
     
     Pool->Size = Size;
     Pool->Base = (uint8_t *)Base;
+    Pool->Committed = Size;
+    Pool->CommitGranularity = 0;
+    Pool->DirtySize = Size;
     Pool->Used = 0;
     Pool->TempCount = 0;
 }
 
+// A pool over memory fresh from Sys_Reserve, memory is committed when it's
+// first pushed and known to be zero until then.
+inline void InitializeReservedMemoryPool(memory_pool *Pool, memory_index Size, void *Base, memory_index CommitGranularity)
+{
+    assert(CommitGranularity > 0 && (CommitGranularity & (CommitGranularity - 1)) == 0);
+    InitializeMemoryPool(Pool, Size, Base);
+    Pool->Committed = 0;
+    Pool->CommitGranularity = CommitGranularity;
+    Pool->DirtySize = 0;
+}
+
+// Commit the range from Offset to the end of the used memory.
+void CommitMemoryPool(memory_pool *Pool, memory_index Offset);
+
 inline memory_index GetAlignmentFromFlags(uint32_t AllocationFlags)
 {
     uint32_t AlignFlag = AllocationFlags & MemoryAllocation_AlignMask;
@@ -100,25 +255,59 @@ inline void *PushSize(memory_pool *Pool, memory_index Size, uint32_t AllocationF
     memory_index AlignmentOffset = GetAlignmentOffset(Pool, Alignment);
     void *Result = Pool->Base + Pool->Used + AlignmentOffset;
     Pool->Used += AlignedSize;
+#if ENABLE_MEMORY_TRACKING
+    TrackPoolAllocation(AlignedSize);
+#endif
+
+    if (Pool->Used > Pool->Committed && !(AllocationFlags & MemoryAllocation_NoCommit))
+    {
+        CommitMemoryPool(Pool, (uint8_t *)Result - Pool->Base);
+    }
+
+    // Only the part below the dirty size can hold old data, the padding in
+    // front of Result isn't cleared
+    memory_index ResultOffset = (uint8_t *)Result - Pool->Base;
+    if ((AllocationFlags & MemoryAllocation_ClearMask) && ResultOffset < Pool->DirtySize)
+    {
+        assert(!(AllocationFlags & MemoryAllocation_NoCommit));
+        memory_index DirtyEnd = ResultOffset + Size;
+        if (DirtyEnd > Pool->DirtySize)
+        {
+            DirtyEnd = Pool->DirtySize;
+        }
+
+        ClearMemory(Result, DirtyEnd - ResultOffset);
+    }
 
-    if (AllocationFlags & MemoryAllocation_ClearMask)
+    if (Pool->Used > Pool->DirtySize)
     {
-        ClearMemory(Result, AlignedSize);
+        Pool->DirtySize = Pool->Used;
     }
 
     return Result;
 }
 
-inline temporaty_memory *PushTemporaryMemory(memory_pool *Pool)
+inline bool CanPushSize(const memory_pool *Pool, memory_index Size, uint32_t AllocationFlags = MemoryAllocation_Default)
 {
-    temporaty_memory Result = {};
+    memory_index Alignment = GetAlignmentFromFlags(AllocationFlags);
+    memory_index AlignedSize = GetAlignedSizeFor(Pool, Size, Alignment);
+    return (Pool->Used + AlignedSize) <= Pool->Size;
+}
+
+// Everything pushed to Pool after PushTemporaryMemory is released again by
+// the matching PopTemporaryMemory, temporary memory has to be popped in
+// reverse order.
+inline temporary_memory PushTemporaryMemory(memory_pool *Pool)
+{
+    temporary_memory Result = {};
 
     Result.Pool = Pool;
     Result.Used = Pool->Used;
     ++Pool->TempCount;
+    return Result;
 }
 
-inline void PopTemporaryMemory(temporaty_memory *TemporaryMemory)
+inline void PopTemporaryMemory(temporary_memory *TemporaryMemory)
 {
     memory_pool *Pool = TemporaryMemory->Pool;
     assert(Pool->Used >= TemporaryMemory->Used);
@@ -130,4 +319,666 @@ inline void PopTemporaryMemory(temporaty_memory *TemporaryMemory)
 inline void CheckMemoryPool(const memory_pool *Pool)
 {
     assert(Pool->TempCount == 0);
-}
\ No newline at end of file
+}
+
+// Carve a pool out of Pool. If Pool commits on demand the new pool does
+// too, so only the part of it that is used gets committed.
+inline void InitializeSubPool(memory_pool *SubPool, memory_pool *Pool, memory_index Size)
+{
+    if (Pool->CommitGranularity)
+    {
+        // What the parent knows to be zero stays zero in the sub pool, and
+        // what it has committed isn't committed again
+        memory_index ParentDirtySize = Pool->DirtySize;
+        void *Base = PushSize(Pool, Size, MemoryAllocation_Align16 | MemoryAllocation_NoCommit);
+        InitializeReservedMemoryPool(SubPool, Size, Base, Pool->CommitGranularity);
+
+        memory_index Offset = (uint8_t *)Base - Pool->Base;
+        SubPool->DirtySize = (ParentDirtySize > Offset) ? ParentDirtySize - Offset : 0;
+        if (SubPool->DirtySize > Size)
+        {
+            SubPool->DirtySize = Size;
+        }
+
+        SubPool->Committed = (Pool->Committed > Offset) ? Pool->Committed - Offset : 0;
+        if (SubPool->Committed > Size)
+        {
+            SubPool->Committed = Size;
+        }
+    }
+    else
+    {
+        void *Base = PushSize(Pool, Size, MemoryAllocation_Align16);
+        InitializeMemoryPool(SubPool, Size, Base);
+    }
+}
+
+// Pops the temporary memory when going out of scope.
+//
+// Usage example:
+//  {
+//      scoped_temporary_memory TempMemory(Pool);
+//      vertex *Vertices = PushArray(Pool, NumVertices, vertex);
+//      ...
+//  }   // Vertices is released here
+//
+struct scoped_temporary_memory
+{
+    temporary_memory Memory;
+
+    scoped_temporary_memory(memory_pool *Pool) : Memory(PushTemporaryMemory(Pool)) {}
+    ~scoped_temporary_memory() { PopTemporaryMemory(&Memory); }
+
+    scoped_temporary_memory(const scoped_temporary_memory &) = delete;
+    scoped_temporary_memory &operator=(const scoped_temporary_memory &) = delete;
+};
+
+// Two arenas used every other frame. Everything allocated during a frame
+// is released at once when its arena comes around again, so data from the
+// previous frame stays valid while the current frame is being built.
+//
+// Usage example:
+//  memory_pool *FrameArena = BeginFrameMemory(&FrameMemory);
+//  visible_surface *VisibleList = PushArray(FrameArena, NumSurfaces, visible_surface);
+//
+struct frame_memory
+{
+    memory_pool Arenas[2];
+    uint32_t CurrentArena;
+    uint64_t FrameIndex;
+    memory_index PeakUsed;
+};
+
+inline void InitializeFrameMemory(frame_memory *FrameMemory, memory_pool *Pool, memory_index ArenaSize)
+{
+    for (uint32_t ArenaIndex = 0; ArenaIndex < 2; ++ArenaIndex)
+    {
+        InitializeSubPool(&FrameMemory->Arenas[ArenaIndex], Pool, ArenaSize);
+    }
+
+    // First BeginFrameMemory flips to arena 0
+    FrameMemory->CurrentArena = 1;
+    FrameMemory->FrameIndex = 0;
+    FrameMemory->PeakUsed = 0;
+}
+
+inline memory_pool *GetFrameArena(frame_memory *FrameMemory)
+{
+    return &FrameMemory->Arenas[FrameMemory->CurrentArena];
+}
+
+inline memory_pool *GetPreviousFrameArena(frame_memory *FrameMemory)
+{
+    return &FrameMemory->Arenas[FrameMemory->CurrentArena ^ 1];
+}
+
+// Flip to the other arena and release everything allocated in it two
+// frames ago.
+inline memory_pool *BeginFrameMemory(frame_memory *FrameMemory)
+{
+    memory_pool *Arena = GetPreviousFrameArena(FrameMemory);
+    CheckMemoryPool(Arena);
+    if (Arena->Used > FrameMemory->PeakUsed)
+    {
+        FrameMemory->PeakUsed = Arena->Used;
+    }
+
+    Arena->Used = 0;
+    FrameMemory->CurrentArena ^= 1;
+    ++FrameMemory->FrameIndex;
+    return Arena;
+}
+
+// Per thread scratch pools for short lived buffers. Size bytes are taken
+// from Pool and split evenly between MaxThreads pools, each thread asking
+// for its scratch pool gets the next unused one. Always push to a scratch
+// pool inside a temporary memory scope.
+void InitializeScratchMemory(memory_pool *Pool, memory_index Size, uint32_t MaxThreads);
+void DestroyScratchMemory();
+
+// Scratch pool of the calling thread, or nullptr if scratch memory isn't
+// initialized or every pool already belongs to another thread.
+memory_pool *GetThreadScratchPool();
+
+// The scratch pool of the calling thread for the rest of the scope, Pool
+// is nullptr if the thread has no scratch pool.
+struct scoped_scratch_memory
+{
+    memory_pool *Pool;
+    temporary_memory TempMemory;
+
+    scoped_scratch_memory() :
+        Pool(GetThreadScratchPool())
+    {
+        if (Pool)
+        {
+            TempMemory = PushTemporaryMemory(Pool);
+        }
+    }
+
+    ~scoped_scratch_memory()
+    {
+        if (Pool)
+        {
+            PopTemporaryMemory(&TempMemory);
+        }
+    }
+
+    scoped_scratch_memory(const scoped_scratch_memory &) = delete;
+    scoped_scratch_memory &operator=(const scoped_scratch_memory &) = delete;
+};
+
+// A buffer that lives until the end of the scope. Taken from the calling
+// threads scratch pool, or the heap if the scratch pool is missing or full.
+//
+// Usage example:
+//  scoped_scratch_buffer FileBuffer(File.GetLength());
+//  File.Read(FileBuffer.Data, File.GetLength());
+//
+struct scoped_scratch_buffer
+{
+    memory_pool *Pool;
+    temporary_memory TempMemory;
+    uint8_t *HeapData;
+    uint8_t *Data;
+
+    scoped_scratch_buffer(memory_index Size, uint32_t AllocationFlags = MemoryAllocation_Align16) :
+        Pool(GetThreadScratchPool()),
+        HeapData(nullptr)
+    {
+        if (Pool && CanPushSize(Pool, Size, AllocationFlags))
+        {
+            TempMemory = PushTemporaryMemory(Pool);
+            Data = (uint8_t *)PushSize(Pool, Size, AllocationFlags);
+        }
+        else
+        {
+            Pool = nullptr;
+            HeapData = new uint8_t[Size];
+            Data = HeapData;
+            if (AllocationFlags & MemoryAllocation_ClearMask)
+            {
+                ClearMemory(Data, Size);
+            }
+        }
+    }
+
+    ~scoped_scratch_buffer()
+    {
+        if (Pool)
+        {
+            PopTemporaryMemory(&TempMemory);
+        }
+
+        delete[] HeapData;
+    }
+
+    scoped_scratch_buffer(const scoped_scratch_buffer &) = delete;
+    scoped_scratch_buffer &operator=(const scoped_scratch_buffer &) = delete;
+};
+
+//
+// Block pool
+//
+
+// Blocks kept in a thread cache before half of them are handed back to the
+// shared free list, and the number of threads that get a cache.
+#define BLOCK_POOL_THREAD_CACHE_SIZE    32
+#define BLOCK_POOL_MAX_THREAD_CACHES    64
+#define BLOCK_POOL_CACHE_LINE_SIZE      64
+
+// Thread cache slot of the calling thread, handed out in the order threads
+// first ask for one and the same for every block pool. Slots aren't reused
+// when a thread exits, threads past BLOCK_POOL_MAX_THREAD_CACHES always go
+// through the shared free list.
+uint32_t GetBlockPoolThreadSlot();
+
+// Fill freed blocks with a pattern and verify it when the block is handed
+// out again, catches writes to objects that were already freed.
+#ifndef BLOCK_POOL_POISON
+#ifdef NDEBUG
+#define BLOCK_POOL_POISON               0
+#else
+#define BLOCK_POOL_POISON               1
+#endif
+#endif
+#define BLOCK_POOL_FREED_BYTE           0xdd
+#define BLOCK_POOL_ALLOCATED_BYTE       0xcd
+
+// Fixed size blocks for objects of type T, allocated in chunks of
+// BlocksPerChunk blocks that are never released until the pool is
+// destroyed. Free blocks are linked through their own storage. Allocate and
+// Free are O(1) and safe to call from any thread, with UseThreadCache each
+// thread keeps a small free list of its own and only takes the lock when it
+// runs empty or grows too large.
+//
+// Usage example:
+//  BlockPool<Particle> particlePool;
+//  Particle *particle = particlePool.New(position, velocity);
+//  ...
+//  particlePool.Delete(particle);
+//
+template <class T, uint32_t BlocksPerChunk = 64, bool UseThreadCache = false>
+class BlockPool
+{
+public:
+    BlockPool() :
+        chunks(nullptr),
+        freeList(nullptr),
+        numAllocated(0),
+        numChunks(0),
+        threadCacheMemory(nullptr),
+        threadCaches(nullptr)
+    {
+        static_assert(sizeof(ThreadCache) == BLOCK_POOL_CACHE_LINE_SIZE, "BlockPool thread caches have to fill a cache line");
+        if (UseThreadCache)
+        {
+            // new only guarantees the alignment of max_align_t, align the
+            // caches to a cache line by hand
+            threadCacheMemory = new uint8_t[sizeof(ThreadCache) * BLOCK_POOL_MAX_THREAD_CACHES + BLOCK_POOL_CACHE_LINE_SIZE - 1];
+            const uintptr_t alignedMemory = ((uintptr_t)threadCacheMemory + BLOCK_POOL_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(BLOCK_POOL_CACHE_LINE_SIZE - 1);
+            threadCaches = (ThreadCache *)alignedMemory;
+            for (uint32_t i = 0; i < BLOCK_POOL_MAX_THREAD_CACHES; ++i)
+            {
+                new (&threadCaches[i]) ThreadCache();
+            }
+        }
+    }
+
+    ~BlockPool()
+    {
+        // Blocks never point into the thread caches, they can always go
+        delete[] threadCacheMemory;
+
+        // Leaking is better than freeing memory that is still in use, which
+        // may happen if an object outlives the pool at exit
+        if (numAllocated != 0)
+        {
+            return;
+        }
+
+        while (chunks)
+        {
+            Chunk *next = chunks->next;
+            delete chunks;
+            chunks = next;
+        }
+    }
+
+    BlockPool(const BlockPool &) = delete;
+    BlockPool &operator=(const BlockPool &) = delete;
+
+    // Uninitialized storage for one T.
+    void *Allocate()
+    {
+        Block *block = nullptr;
+        ThreadCache *cache = GetThreadCache();
+        if (cache)
+        {
+            if (!cache->freeList)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                for (uint32_t i = 0; i < BLOCK_POOL_THREAD_CACHE_SIZE; ++i)
+                {
+                    Block *sharedBlock = PopSharedBlock();
+                    sharedBlock->next = cache->freeList;
+                    cache->freeList = sharedBlock;
+                }
+
+                cache->count = BLOCK_POOL_THREAD_CACHE_SIZE;
+            }
+
+            block = cache->freeList;
+            cache->freeList = block->next;
+            --cache->count;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            block = PopSharedBlock();
+        }
+
+#if BLOCK_POOL_POISON
+        const uint8_t *bytes = (const uint8_t *)block;
+        for (size_t i = sizeof(Block *); i < sizeof(Block); ++i)
+        {
+            assert(bytes[i] == BLOCK_POOL_FREED_BYTE && "Block was written to after it was freed");
+        }
+
+        memset(block, BLOCK_POOL_ALLOCATED_BYTE, sizeof(Block));
+#endif
+
+        numAllocated.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    void Free(void *pointer)
+    {
+        if (!pointer)
+        {
+            return;
+        }
+
+        Block *block = (Block *)pointer;
+#if BLOCK_POOL_POISON
+        memset(block, BLOCK_POOL_FREED_BYTE, sizeof(Block));
+#endif
+
+        numAllocated.fetch_sub(1, std::memory_order_relaxed);
+        ThreadCache *cache = GetThreadCache();
+        if (cache)
+        {
+            block->next = cache->freeList;
+            cache->freeList = block;
+            if (++cache->count >= BLOCK_POOL_THREAD_CACHE_SIZE * 2)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                for (uint32_t i = 0; i < BLOCK_POOL_THREAD_CACHE_SIZE; ++i)
+                {
+                    Block *cachedBlock = cache->freeList;
+                    cache->freeList = cachedBlock->next;
+                    cachedBlock->next = freeList;
+                    freeList = cachedBlock;
+                }
+
+                cache->count -= BLOCK_POOL_THREAD_CACHE_SIZE;
+            }
+        }
+        else
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+
+    template <class... Args>
+    T *New(Args&&... args)
+    {
+        return new (Allocate()) T(std::forward<Args>(args)...);
+    }
+
+    void Delete(T *object)
+    {
+        if (object)
+        {
+            object->~T();
+            Free(object);
+        }
+    }
+
+    uint32_t GetNumAllocated() const { return numAllocated.load(std::memory_order_relaxed); }
+    uint32_t GetNumChunks() const { return numChunks; }
+
+private:
+    union Block
+    {
+        Block *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    struct Chunk
+    {
+        Block blocks[BlocksPerChunk];
+        Chunk *next;
+    };
+
+    // Padded and aligned so caches of different threads don't share a
+    // cache line
+    struct ThreadCache
+    {
+        Block *freeList;
+        uint32_t count;
+        uint8_t padding[BLOCK_POOL_CACHE_LINE_SIZE - sizeof(Block *) - sizeof(uint32_t)];
+    };
+
+    ThreadCache *GetThreadCache()
+    {
+        if (!UseThreadCache)
+        {
+            return nullptr;
+        }
+
+        const uint32_t threadSlot = GetBlockPoolThreadSlot();
+        return threadSlot < BLOCK_POOL_MAX_THREAD_CACHES ? &threadCaches[threadSlot] : nullptr;
+    }
+
+    // Has to be called with the lock held.
+    Block *PopSharedBlock()
+    {
+        if (!freeList)
+        {
+            Chunk *chunk = new Chunk;
+            for (uint32_t i = 0; i < BlocksPerChunk; ++i)
+            {
+#if BLOCK_POOL_POISON
+                memset(&chunk->blocks[i], BLOCK_POOL_FREED_BYTE, sizeof(Block));
+#endif
+                chunk->blocks[i].next = (i + 1 < BlocksPerChunk) ? &chunk->blocks[i + 1] : nullptr;
+            }
+
+            chunk->next = chunks;
+            chunks = chunk;
+            freeList = &chunk->blocks[0];
+            ++numChunks;
+        }
+
+        Block *block = freeList;
+        freeList = block->next;
+        return block;
+    }
+
+    std::mutex lock;
+    Chunk *chunks;
+    Block *freeList;
+    std::atomic<uint32_t> numAllocated;
+    uint32_t numChunks;
+    uint8_t *threadCacheMemory;
+    ThreadCache *threadCaches;         // Cache line aligned inside threadCacheMemory
+};
+
+// Pool shared by everything allocating objects of type T, with thread caches.
+template <class T>
+BlockPool<T, 64, true> &GetGlobalBlockPool()
+{
+    static BlockPool<T, 64, true> pool;
+    return pool;
+}
+
+// Standard library allocator taking single objects from the global block
+// pool of the type, larger requests go to the heap. Makes std::allocate_shared
+// put the object and its reference count in one pooled block, and node
+// based containers keep their nodes close together.
+//
+// Usage example:
+//  auto buffer = std::allocate_shared<OpenGLBuffer>(BlockPoolAllocator<OpenGLBuffer>(), ...);
+//  std::list<Surface, BlockPoolAllocator<Surface>> surfaceList;
+//
+template <class T>
+struct BlockPoolAllocator
+{
+    typedef T value_type;
+
+    BlockPoolAllocator() = default;
+    template <class U> BlockPoolAllocator(const BlockPoolAllocator<U> &) {}
+
+    T *allocate(size_t count)
+    {
+        if (count == 1)
+        {
+            return (T *)GetGlobalBlockPool<T>().Allocate();
+        }
+
+        return (T *)::operator new(count * sizeof(T));
+    }
+
+    void deallocate(T *pointer, size_t count)
+    {
+        if (count == 1)
+        {
+            GetGlobalBlockPool<T>().Free(pointer);
+            return;
+        }
+
+        ::operator delete(pointer);
+    }
+};
+
+template <class T, class U>
+bool operator==(const BlockPoolAllocator<T> &, const BlockPoolAllocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const BlockPoolAllocator<T> &, const BlockPoolAllocator<U> &) { return false; }
+
+//
+// TLSF heap
+//
+
+// Two level segregated fit allocator over a fixed block of memory. Free
+// blocks are kept in TLSF_FL_COUNT * TLSF_SL_COUNT size classes with a
+// bitmap of the non empty ones, so both allocating and freeing are O(1)
+// and a request never wastes more than 1/TLSF_SL_COUNT of the block it
+// gets. Allocations are aligned to TLSF_ALIGNMENT, the heap is locked
+// internally.
+//
+// Blocks are limited to 2^TLSF_FL_INDEX_MAX bytes, 64 GB where memory_index
+// is 64 bit and 2 GB where it's 32 bit.
+#define TLSF_SL_INDEX_COUNT_LOG2    5
+#define TLSF_ALIGNMENT_LOG2         4
+#define TLSF_FL_INDEX_MAX           (sizeof(memory_index) == 8 ? 36 : 31)
+#define TLSF_ALIGNMENT              (1 << TLSF_ALIGNMENT_LOG2)
+#define TLSF_SL_COUNT               (1 << TLSF_SL_INDEX_COUNT_LOG2)
+#define TLSF_FL_SHIFT               (TLSF_SL_INDEX_COUNT_LOG2 + TLSF_ALIGNMENT_LOG2)
+#define TLSF_FL_COUNT               (TLSF_FL_INDEX_MAX - TLSF_FL_SHIFT + 1)
+
+struct tlsf_block;
+
+struct tlsf_heap
+{
+    uint8_t *Base;
+    memory_index Size;
+    memory_index Used;
+    memory_index PeakUsed;
+    uint32_t NumAllocations;
+
+    uint32_t FlBitmap;
+    uint32_t SlBitmap[TLSF_FL_COUNT];
+    tlsf_block *FreeBlocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    std::mutex Lock;
+};
+
+static_assert(TLSF_FL_INDEX_MAX < sizeof(memory_index) * 8, "TLSF block sizes have to fit in memory_index");
+static_assert(TLSF_FL_COUNT <= 32, "TLSF first level bitmap has 32 bits");
+
+struct tlsf_heap_stats
+{
+    memory_index Size;
+    memory_index Used;
+    memory_index PeakUsed;
+    memory_index Free;
+    memory_index LargestFreeBlock;
+    uint32_t NumUsedBlocks;
+    uint32_t NumFreeBlocks;
+
+    // 0 when all free memory is one block, approaching 1 the more it is
+    // split up
+    float Fragmentation;
+};
+
+void InitializeTlsfHeap(tlsf_heap *Heap, void *Base, memory_index Size);
+
+// Returns nullptr if no free block is large enough.
+void *TlsfAlloc(tlsf_heap *Heap, memory_index Size);
+void TlsfFree(tlsf_heap *Heap, void *Memory);
+
+// Walks every block in the heap, only meant for reports.
+void GetTlsfHeapStats(tlsf_heap *Heap, tlsf_heap_stats *Stats);
+void DebugLogTlsfHeap(tlsf_heap *Heap, const char *Name);
+
+// Standard library allocator over a TLSF heap.
+//
+// Usage example:
+//  std::vector<uint32_t, TlsfAllocator<uint32_t>> indices(TlsfAllocator<uint32_t>(&permanentHeap));
+//
+template <class T>
+struct TlsfAllocator
+{
+    typedef T value_type;
+
+    tlsf_heap *heap;
+
+    explicit TlsfAllocator(tlsf_heap *inHeap) : heap(inHeap) {}
+    template <class U> TlsfAllocator(const TlsfAllocator<U> &other) : heap(other.heap) {}
+
+    T *allocate(size_t count)
+    {
+        static_assert(alignof(T) <= TLSF_ALIGNMENT, "TLSF heap can't align the type");
+        void *memory = TlsfAlloc(heap, count * sizeof(T));
+        if (!memory)
+        {
+            throw std::bad_alloc();
+        }
+
+        return (T *)memory;
+    }
+
+    void deallocate(T *pointer, size_t)
+    {
+        TlsfFree(heap, pointer);
+    }
+};
+
+template <class T, class U>
+bool operator==(const TlsfAllocator<T> &a, const TlsfAllocator<U> &b) { return a.heap == b.heap; }
+template <class T, class U>
+bool operator!=(const TlsfAllocator<T> &a, const TlsfAllocator<U> &b) { return a.heap != b.heap; }
+
+
+//
+// Memory pool allocator
+//
+
+// Standard library allocator pushing to a memory pool. Nothing is given
+// back to the pool on deallocate, everything is released at once when the
+// pool is reset or popped. Falls back to the heap when the pool is full or
+// nullptr. Not thread safe, just like the pool.
+//
+// Usage example:
+//  std::vector<Vec3f, MemoryPoolAllocator<Vec3f>> positions(MemoryPoolAllocator<Vec3f>(&importPool));
+//
+template <class T>
+struct MemoryPoolAllocator
+{
+    typedef T value_type;
+
+    memory_pool *pool;
+
+    explicit MemoryPoolAllocator(memory_pool *inPool) : pool(inPool) {}
+    template <class U> MemoryPoolAllocator(const MemoryPoolAllocator<U> &other) : pool(other.pool) {}
+
+    T *allocate(size_t count)
+    {
+        static_assert(alignof(T) <= 16, "Memory pool allocator can't align the type");
+        const uint32_t flags = alignof(T) <= 4 ? MemoryAllocation_Align4 : (alignof(T) <= 8 ? MemoryAllocation_Align8 : MemoryAllocation_Align16);
+        const memory_index size = count * sizeof(T);
+        if (pool && CanPushSize(pool, size, flags))
+        {
+            return (T *)PushSize(pool, size, flags);
+        }
+
+        return (T *)::operator new(size);
+    }
+
+    void deallocate(T *pointer, size_t)
+    {
+        if (!pool || (uint8_t *)pointer < pool->Base || (uint8_t *)pointer >= pool->Base + pool->Size)
+        {
+            ::operator delete(pointer);
+        }
+    }
+};
+
+template <class T, class U>
+bool operator==(const MemoryPoolAllocator<T> &a, const MemoryPoolAllocator<U> &b) { return a.pool == b.pool; }
+template <class T, class U>
+bool operator!=(const MemoryPoolAllocator<T> &a, const MemoryPoolAllocator<U> &b) { return a.pool != b.pool; }
\ No newline at end of file
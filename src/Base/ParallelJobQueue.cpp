@@ -1,85 +1,826 @@
 #include "Precompiled.h"
 #include "Base/ParallelJobQueue.h"
+#include "Base/Debug.h"
 #include "Base/Sys.h"
-#include <Windows.h>
+#include "Base/Container/TempArray.h"
 
-static DWORD WINAPI ThreadEntryProc(LPVOID lpParameter)
+static parallel_job_queue StaticJobQueue;
+parallel_job_queue *GlobalJobQueue = &StaticJobQueue;
+
+static thread_local job_worker *CurrentWorker = nullptr;
+
+uint32_t GetJobThreadIndex()
 {
-    parallel_job_queue *Queue = (parallel_job_queue *)lpParameter;
-//    uint32_t threadIndex = GetThreadID();
+    return CurrentWorker ? CurrentWorker->ThreadIndex : JOB_THREAD_INDEX_NONE;
+}
 
-    for (;;)
+job_priority GetCurrentJobPriority()
+{
+    return CurrentWorker ? CurrentWorker->CurrentPriority : JobPriority_Normal;
+}
+
+//
+// Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak
+// Memory Models" (Le, Pop, Cohen, Nardelli) for the memory ordering.
+//
+static bool PushBottom(job_deque *Deque, const job_entry &Entry)
+{
+    int64_t Bottom = Deque->Bottom.load(std::memory_order_relaxed);
+    int64_t Top = Deque->Top.load(std::memory_order_acquire);
+    if (Bottom - Top >= NUM_ENTRIES_PER_DEQUE)
+    {
+        return false;
+    }
+
+    Deque->Entries[Bottom & (NUM_ENTRIES_PER_DEQUE - 1)] = Entry;
+    std::atomic_thread_fence(std::memory_order_release);
+    Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+static bool PopBottom(job_deque *Deque, job_entry *OutEntry)
+{
+    int64_t Bottom = Deque->Bottom.load(std::memory_order_relaxed) - 1;
+    Deque->Bottom.store(Bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t Top = Deque->Top.load(std::memory_order_relaxed);
+
+    if (Top > Bottom)
+    {
+        // Deque was empty
+        Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *OutEntry = Deque->Entries[Bottom & (NUM_ENTRIES_PER_DEQUE - 1)];
+    if (Top == Bottom)
+    {
+        // Last entry, race against thieves for it
+        bool Won = Deque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+        return Won;
+    }
+
+    return true;
+}
+
+static bool StealTop(job_deque *Deque, job_entry *OutEntry)
+{
+    int64_t Top = Deque->Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t Bottom = Deque->Bottom.load(std::memory_order_acquire);
+    if (Top >= Bottom)
+    {
+        return false;
+    }
+
+    *OutEntry = Deque->Entries[Top & (NUM_ENTRIES_PER_DEQUE - 1)];
+    return Deque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static bool IsDequeEmpty(const job_deque *Deque)
+{
+    return Deque->Top.load(std::memory_order_acquire) >= Deque->Bottom.load(std::memory_order_acquire);
+}
+
+//
+// Shared lanes for jobs submitted from outside the queue
+//
+static bool IsLaneEmpty(const job_lane *Lane)
+{
+    return Lane->Ring.IsEmpty() &&
+           Lane->NumOverflowJobs.load(std::memory_order_acquire) == 0;
+}
+
+static void PushOverflow(job_lane *Lane, const job_entry &Entry)
+{
+    std::lock_guard<std::mutex> Lock(Lane->OverflowLock);
+    Lane->OverflowJobs.push_back(Entry);
+    Lane->NumOverflowJobs.fetch_add(1, std::memory_order_release);
+}
+
+static bool PopOverflow(job_lane *Lane, job_entry *OutEntry)
+{
+    if (Lane->NumOverflowJobs.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(Lane->OverflowLock);
+    if (Lane->OverflowJobs.empty())
+    {
+        return false;
+    }
+
+    *OutEntry = Lane->OverflowJobs.front();
+    Lane->OverflowJobs.pop_front();
+    Lane->NumOverflowJobs.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+static bool IsBackgroundSlotAvailable(const parallel_job_queue *Queue)
+{
+    return Queue->NumActiveBackgroundJobs.load(std::memory_order_acquire) < Queue->MaxBackgroundJobs;
+}
+
+static bool HasPendingJobs(const parallel_job_queue *Queue, uint32_t Priority)
+{
+    if (!IsLaneEmpty(&Queue->Lanes[Priority]))
     {
-        uint32_t OriginalNextEntryRead = Queue->NextEntryRead;
-        uint32_t NewNextEntryRead = (OriginalNextEntryRead + 1) % _countof(Queue->JobEntries);
-        
-        if (OriginalNextEntryRead != Queue->NextEntryWrite)
+        return true;
+    }
+
+    for (uint32_t WorkerIndex = 0; WorkerIndex < Queue->NumWorkerSlots; ++WorkerIndex)
+    {
+        if (!IsDequeEmpty(&Queue->Workers[WorkerIndex].Deques[Priority]))
         {
-            uint32_t Index = AtomicCompareExchangeUInt32(&Queue->NextEntryRead,
-                                                         NewNextEntryRead,
-                                                         OriginalNextEntryRead);
-            if (Index == OriginalNextEntryRead)
-            {
-                job_entry Entry = Queue->JobEntries[Index];
-                Entry.Callback(Entry.Data);
-                AtomicAddUint32(&Queue->CompletionCount, 1);
-            }
-        } 
-        else
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool HasRunnableJobs(const job_worker *Worker)
+{
+    // Background jobs don't count while the worker can't take a background
+    // slot, a parked worker would just wake up and find nothing to run
+    const parallel_job_queue *Queue = Worker->Queue;
+    for (uint32_t Priority = 0; Priority < NUM_JOB_PRIORITIES; ++Priority)
+    {
+        if (Priority == JobPriority_Background &&
+            (!Worker->RunsBackgroundJobs || (Worker->BackgroundJobDepth == 0 && !IsBackgroundSlotAvailable(Queue))))
+        {
+            break;
+        }
+
+        if (HasPendingJobs(Queue, Priority))
         {
-            WaitForSingleObjectEx(Queue->SemaphoreHandle, INFINITE, FALSE);
+            return true;
         }
     }
 
-//    return 0;
+    return false;
+}
+
+static void WakeSleepingWorker(parallel_job_queue *Queue)
+{
+    // The seq_cst fence pairs with the NumSleepingWorkers increment in
+    // ThreadEntryProc so either we see the sleeper or it sees the new entry
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (Queue->NumSleepingWorkers.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> Lock(Queue->ParkingLock);
+        Queue->WorkAvailable.notify_one();
+    }
+    else if (Queue->NumSleepingHelpers.load(std::memory_order_seq_cst) > 0)
+    {
+        // Waiters share the condition variable with other waiters
+        std::lock_guard<std::mutex> Lock(Queue->ParkingLock);
+        Queue->QueueFinished.notify_all();
+    }
+}
+
+static uint32_t NextRandom(job_worker *Worker)
+{
+    uint32_t x = Worker->RandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    Worker->RandomState = x;
+    return x;
+}
+
+static bool TryAcquireBackgroundSlot(parallel_job_queue *Queue)
+{
+    uint32_t NumActive = Queue->NumActiveBackgroundJobs.load(std::memory_order_relaxed);
+    do
+    {
+        if (NumActive >= Queue->MaxBackgroundJobs)
+        {
+            return false;
+        }
+    } while (!Queue->NumActiveBackgroundJobs.compare_exchange_weak(NumActive, NumActive + 1, std::memory_order_acquire, std::memory_order_relaxed));
+
+    return true;
+}
+
+static void ReleaseBackgroundSlot(parallel_job_queue *Queue)
+{
+    Queue->NumActiveBackgroundJobs.fetch_sub(1, std::memory_order_release);
+
+    // A worker may have parked on background work because of the cap
+    if (HasPendingJobs(Queue, JobPriority_Background))
+    {
+        WakeSleepingWorker(Queue);
+    }
+}
+
+static bool FindJobInLane(job_worker *Worker, uint32_t Priority, job_entry *OutEntry)
+{
+    if (PopBottom(&Worker->Deques[Priority], OutEntry))
+    {
+        return true;
+    }
+
+    parallel_job_queue *Queue = Worker->Queue;
+    job_lane *Lane = &Queue->Lanes[Priority];
+    if (Lane->Ring.TryPop(OutEntry) || PopOverflow(Lane, OutEntry))
+    {
+        return true;
+    }
+
+    // Start at a random victim so thieves spread out over the deques
+    const uint32_t NumWorkerSlots = Queue->NumWorkerSlots;
+    const uint32_t FirstVictim = NextRandom(Worker) % NumWorkerSlots;
+    for (uint32_t i = 0; i < NumWorkerSlots; ++i)
+    {
+        job_worker *Victim = &Queue->Workers[(FirstVictim + i) % NumWorkerSlots];
+        if (Victim != Worker && StealTop(&Victim->Deques[Priority], OutEntry))
+        {
+            DebugTraceEvent(DebugTraceEvent_Instant, "Steal", Victim->ThreadIndex);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool FindJobByPriority(job_worker *Worker, job_entry *OutEntry)
+{
+    for (uint32_t Priority = 0; Priority < JobPriority_Background; ++Priority)
+    {
+        if (FindJobInLane(Worker, Priority, OutEntry))
+        {
+            return true;
+        }
+    }
+
+    if (!Worker->RunsBackgroundJobs)
+    {
+        return false;
+    }
+
+    // A worker already inside a background job keeps its slot for nested
+    // jobs, otherwise it could deadlock waiting on its own children
+    parallel_job_queue *Queue = Worker->Queue;
+    const bool NeedsSlot = (Worker->BackgroundJobDepth == 0);
+    if (NeedsSlot && !TryAcquireBackgroundSlot(Queue))
+    {
+        return false;
+    }
+
+    if (FindJobInLane(Worker, JobPriority_Background, OutEntry))
+    {
+        // The slot is released by ExecuteJob
+        return true;
+    }
+
+    if (NeedsSlot)
+    {
+        ReleaseBackgroundSlot(Queue);
+    }
+
+    return false;
+}
+
+static bool FindJob(job_worker *Worker, job_entry *OutEntry)
+{
+    if (FindJobByPriority(Worker, OutEntry))
+    {
+        return true;
+    }
+
+    // Nothing to run or steal in any lane the worker can take jobs from
+    DebugTraceEvent(DebugTraceEvent_Instant, "StealFailed");
+    return false;
+}
+
+static void ExecuteJob(job_worker *Worker, const job_entry &Entry)
+{
+    parallel_job_queue *Queue = Worker->Queue;
+    const job_priority PreviousPriority = Worker->CurrentPriority;
+    const bool IsBackground = (Entry.Priority == JobPriority_Background);
+    Worker->CurrentPriority = Entry.Priority;
+    if (IsBackground)
+    {
+        ++Worker->BackgroundJobDepth;
+    }
+
+    DebugTraceEvent(DebugTraceEvent_Begin, Entry.Name ? Entry.Name : "Job");
+    Entry.Callback(Entry.Data);
+    DebugTraceEvent(DebugTraceEvent_End, Entry.Name ? Entry.Name : "Job");
+
+    if (IsBackground && --Worker->BackgroundJobDepth == 0)
+    {
+        ReleaseBackgroundSlot(Queue);
+    }
+    Worker->CurrentPriority = PreviousPriority;
+
+    if (Entry.Counter)
+    {
+        DecrementJobCounter(Queue, Entry.Counter);
+    }
+
+    uint32_t CompletionCount = Queue->CompletionCount.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (CompletionCount == Queue->CompletionGoal.load(std::memory_order_acquire))
+    {
+        // Notify under the lock so a waiter can't miss the wakeup between
+        // checking the counters and going to sleep
+        std::lock_guard<std::mutex> Lock(Queue->ParkingLock);
+        Queue->QueueFinished.notify_all();
+    }
+}
+
+static void ThreadEntryProc(job_worker *Worker)
+{
+    parallel_job_queue *Queue = Worker->Queue;
+    CurrentWorker = Worker;
+
+    char ThreadName[32];
+    snprintf(ThreadName, sizeof(ThreadName), "Job worker %u", Worker->ThreadIndex);
+    DebugTraceSetThreadName(ThreadName);
+    if (Worker->ProcessorId != JOB_PROCESSOR_ANY)
+    {
+        Sys_SetCurrentThreadAffinity(Worker->ProcessorId);
+    }
+
+    while (!Queue->ShutdownRequested.load(std::memory_order_acquire))
+    {
+        job_entry Entry;
+        if (FindJob(Worker, &Entry))
+        {
+            ExecuteJob(Worker, Entry);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> Lock(Queue->ParkingLock);
+        Queue->NumSleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        DebugTraceEvent(DebugTraceEvent_Begin, "Parked");
+        Queue->WorkAvailable.wait(Lock, [Queue, Worker]()
+        {
+            return HasRunnableJobs(Worker) || Queue->ShutdownRequested.load(std::memory_order_acquire);
+        });
+        DebugTraceEvent(DebugTraceEvent_End, "Parked");
+        Queue->NumSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    CurrentWorker = nullptr;
 }
 
-void CreateParallelJobQueue(parallel_job_queue *Queue, uint32_t numThreads)
+// Run jobs on Worker until IsDone returns true, parking on QueueFinished
+// while there's nothing the worker can run
+template <typename Predicate>
+static void RunJobsUntil(job_worker *Worker, const Predicate &IsDone)
 {
+    parallel_job_queue *Queue = Worker->Queue;
+    while (!IsDone())
+    {
+        job_entry Entry;
+        if (FindJob(Worker, &Entry))
+        {
+            ExecuteJob(Worker, Entry);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> Lock(Queue->ParkingLock);
+        Queue->NumSleepingHelpers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        DebugTraceEvent(DebugTraceEvent_Begin, "Parked");
+        Queue->QueueFinished.wait(Lock, [Worker, &IsDone]()
+        {
+            return IsDone() || HasRunnableJobs(Worker);
+        });
+        DebugTraceEvent(DebugTraceEvent_End, "Parked");
+        Queue->NumSleepingHelpers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void CreateParallelJobQueue(parallel_job_queue *Queue, uint32_t NumThreads, const uint32_t *ProcessorIds)
+{
+    assert(NumThreads > 0);
+
     Queue->CompletionGoal = 0;
     Queue->CompletionCount = 0;
-    Queue->NextEntryWrite = 0;
-    Queue->NextEntryRead = 0;
-    for (uint32_t i = 0; i < _countof(Queue->JobEntries); ++i)
+    for (uint32_t Priority = 0; Priority < NUM_JOB_PRIORITIES; ++Priority)
+    {
+        job_lane *Lane = &Queue->Lanes[Priority];
+        Lane->Ring.Reset();
+        Lane->NumOverflowJobs = 0;
+    }
+    Queue->NumActiveBackgroundJobs = 0;
+    Queue->MaxBackgroundJobs = NumThreads > 1 ? NumThreads - 1 : 1;
+    Queue->NumSleepingWorkers = 0;
+    Queue->NumSleepingHelpers = 0;
+    Queue->ShutdownRequested = false;
+
+    Queue->Workers.reset(new job_worker[NumThreads + 1]);
+    Queue->NumWorkers = NumThreads;
+    Queue->NumWorkerSlots = NumThreads + 1;
+    for (uint32_t ThreadIndex = 0; ThreadIndex < Queue->NumWorkerSlots; ++ThreadIndex)
+    {
+        job_worker *Worker = &Queue->Workers[ThreadIndex];
+        for (uint32_t Priority = 0; Priority < NUM_JOB_PRIORITIES; ++Priority)
+        {
+            Worker->Deques[Priority].Top = 0;
+            Worker->Deques[Priority].Bottom = 0;
+        }
+        Worker->Queue = Queue;
+        Worker->ThreadIndex = ThreadIndex;
+        Worker->ProcessorId = (ProcessorIds && ThreadIndex < NumThreads) ? ProcessorIds[ThreadIndex] : JOB_PROCESSOR_ANY;
+        Worker->RandomState = 0x9e3779b9u * (ThreadIndex + 1);
+        Worker->CurrentPriority = JobPriority_Normal;
+        Worker->BackgroundJobDepth = 0;
+
+        // The creating thread waits on frame work, a long background job
+        // picked up while waiting would stall it
+        Worker->RunsBackgroundJobs = (ThreadIndex < NumThreads);
+    }
+
+    CurrentWorker = &Queue->Workers[NumThreads];
+
+    Queue->WorkerThreads.reserve(NumThreads);
+    for (uint32_t ThreadIndex = 0; ThreadIndex < NumThreads; ++ThreadIndex)
     {
-        Queue->JobEntries[i].Executed = true;
+        Queue->WorkerThreads.emplace_back(ThreadEntryProc, &Queue->Workers[ThreadIndex]);
     }
+}
 
+void DestroyParallelJobQueue(parallel_job_queue *Queue)
+{
+    {
+        std::lock_guard<std::mutex> Lock(Queue->ParkingLock);
+        Queue->ShutdownRequested.store(true, std::memory_order_release);
+        Queue->WorkAvailable.notify_all();
+    }
 
-    Queue->SemaphoreHandle = CreateSemaphoreEx(0, 0, numThreads, 0, 0, SEMAPHORE_ALL_ACCESS);
+    for (auto &Thread : Queue->WorkerThreads)
+    {
+        Thread.join();
+    }
 
-    for (uint32_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    if (CurrentWorker && CurrentWorker->Queue == Queue)
     {
-        DWORD threadId = 0;
-        HANDLE threadHandle = CreateThread(0, 0, ThreadEntryProc, Queue, 0, &threadId);
-        CloseHandle(threadHandle);
+        CurrentWorker = nullptr;
     }
+
+    Queue->WorkerThreads.clear();
+    Queue->Workers.reset();
+    Queue->NumWorkers = 0;
+    Queue->NumWorkerSlots = 0;
+}
+
+void SubmitJob(parallel_job_queue *Queue, job_callback Callback, void *Data, job_counter *Counter, job_priority Priority)
+{
+    SubmitNamedJob(Queue, nullptr, Callback, Data, Counter, Priority);
 }
 
-void SubmitJob(parallel_job_queue *Queue, job_callback Callback, void *Data)
+void SubmitNamedJob(parallel_job_queue *Queue, const char *Name, job_callback Callback, void *Data, job_counter *Counter, job_priority Priority)
 {
-    uint32_t NewNextEntryWrite = (Queue->NextEntryWrite + 1) % _countof(Queue->JobEntries);
-    assert(NewNextEntryWrite != Queue->NextEntryRead);
+    assert(Priority < NUM_JOB_PRIORITIES);
 
-    job_entry *Entry = Queue->JobEntries + Queue->NextEntryWrite;
-    assert(Entry->Executed != false);       // Need bigger NUM_ENTRIES_PER_QUEUE if this failes
+    job_entry Entry;
+    Entry.Callback = Callback;
+    Entry.Data = Data;
+    Entry.Counter = Counter;
+    Entry.Priority = Priority;
+    Entry.Name = Name;
+    const uint32_t CompletionGoal = Queue->CompletionGoal.fetch_add(1, std::memory_order_relaxed) + 1;
+    DebugTraceEvent(DebugTraceEvent_Counter, "JobQueueDepth", (int32_t)(CompletionGoal - Queue->CompletionCount.load(std::memory_order_relaxed)));
+    if (Counter)
+    {
+        IncrementJobCounter(Counter);
+    }
+
+    // Jobs spawned from inside a job stay on the spawning workers deque,
+    // everything else (and anything that doesn't fit) goes to the shared lane
+    job_worker *Worker = CurrentWorker;
+    job_lane *Lane = &Queue->Lanes[Priority];
+    bool Pushed = Worker && Worker->Queue == Queue && PushBottom(&Worker->Deques[Priority], Entry);
+    if (!Pushed && !Lane->Ring.TryPush(Entry))
+    {
+        PushOverflow(Lane, Entry);
+    }
 
-    Entry->Callback = Callback;
-    Entry->Data = Data;
-    Entry->Executed = false;
-    ++Queue->CompletionGoal;
+    WakeSleepingWorker(Queue);
+}
 
-    _WriteBarrier();
-    Queue->NextEntryWrite = NewNextEntryWrite;
-    ReleaseSemaphore(Queue->SemaphoreHandle, 1, 0);
+static bool IsQueueFinished(const parallel_job_queue *Queue)
+{
+    return Queue->CompletionCount.load(std::memory_order_acquire) ==
+           Queue->CompletionGoal.load(std::memory_order_acquire);
 }
 
 void WaitForQueueToFinish(parallel_job_queue *Queue)
 {
-    while (Queue->CompletionGoal != Queue->CompletionCount)
+    job_worker *Worker = CurrentWorker;
+    if (Worker && Worker->Queue == Queue)
     {
+        RunJobsUntil(Worker, [Queue]() { return IsQueueFinished(Queue); });
+        return;
     }
 
-    Queue->CompletionGoal = 0;
-    Queue->CompletionCount = 0;
+    std::unique_lock<std::mutex> Lock(Queue->ParkingLock);
+    Queue->QueueFinished.wait(Lock, [Queue]()
+    {
+        return IsQueueFinished(Queue);
+    });
+}
+
+void WaitForCounter(parallel_job_queue *Queue, job_counter *Counter)
+{
+    // A worker blocking here could deadlock the pool if every worker ends
+    // up waiting on a nested counter, so keep executing jobs instead
+    job_worker *Worker = CurrentWorker;
+    if (Worker && Worker->Queue == Queue)
+    {
+        RunJobsUntil(Worker, [Counter]() { return IsJobCounterDone(Counter); });
+        return;
+    }
+
+    std::unique_lock<std::mutex> Lock(Queue->ParkingLock);
+    Queue->QueueFinished.wait(Lock, [Counter]()
+    {
+        return IsJobCounterDone(Counter);
+    });
+}
+
+//
+// Job counters
+//
+static void LockJobCounter(job_counter *Counter)
+{
+    uint32_t Unlocked = 0;
+    while (!Counter->WaitLock.compare_exchange_weak(Unlocked, 1, std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        Unlocked = 0;
+        std::this_thread::yield();
+    }
+}
+
+static void UnlockJobCounter(job_counter *Counter)
+{
+    Counter->WaitLock.store(0, std::memory_order_release);
+}
+
+bool IsJobCounterDone(const job_counter *Counter)
+{
+    // The transition to zero happens with the lock held, checking that it's
+    // released makes sure the decrementing thread is done with the counter
+    // before a waiter is allowed to destroy it
+    return Counter->Value.load(std::memory_order_acquire) == 0 &&
+           Counter->WaitLock.load(std::memory_order_acquire) == 0;
+}
+
+void IncrementJobCounter(job_counter *Counter, uint32_t Amount)
+{
+    Counter->Value.fetch_add(Amount, std::memory_order_relaxed);
+}
+
+void DecrementJobCounter(parallel_job_queue *Queue, job_counter *Counter)
+{
+    // Only the final decrement takes the lock, all others are a plain CAS
+    uint32_t Value = Counter->Value.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        assert(Value > 0);
+        if (Value > 1)
+        {
+            if (Counter->Value.compare_exchange_weak(Value, Value - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            continue;
+        }
+
+        LockJobCounter(Counter);
+        if (Counter->Value.compare_exchange_strong(Value, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            break;
+        }
+
+        UnlockJobCounter(Counter);
+    }
+
+    job_counter_waiter *Waiter = Counter->Waiters;
+    Counter->Waiters = nullptr;
+    UnlockJobCounter(Counter);
+
+    while (Waiter)
+    {
+        // Waiter may be gone as soon as its job is submitted
+        job_counter_waiter *NextWaiter = Waiter->Next;
+        const job_entry Entry = Waiter->Entry;
+        SubmitNamedJob(Waiter->Queue, Entry.Name, Entry.Callback, Entry.Data, Entry.Counter, Entry.Priority);
+        Waiter = NextWaiter;
+    }
+
+    std::lock_guard<std::mutex> Lock(Queue->ParkingLock);
+    Queue->QueueFinished.notify_all();
+}
+
+bool AddJobCounterWaiter(job_counter *Counter, job_counter_waiter *Waiter)
+{
+    // Don't take the lock of a finished counter, WaitForCounter would see
+    // it held and park
+    if (IsJobCounterDone(Counter))
+    {
+        return false;
+    }
+
+    LockJobCounter(Counter);
+    bool Registered = Counter->Value.load(std::memory_order_acquire) != 0;
+    if (Registered)
+    {
+        Waiter->Next = Counter->Waiters;
+        Counter->Waiters = Waiter;
+    }
+
+    UnlockJobCounter(Counter);
+
+    // The counter reached zero before the lock was taken, a thread that
+    // parked in WaitForCounter while it was held missed the notification
+    if (!Registered)
+    {
+        std::lock_guard<std::mutex> Lock(Waiter->Queue->ParkingLock);
+        Waiter->Queue->QueueFinished.notify_all();
+    }
+
+    return Registered;
+}
+
+//
+// Job graph
+//
+static void ExecuteJobGraphNode(void *Data)
+{
+    job_graph_node *Node = (job_graph_node *)Data;
+    Node->Callback(Node->Data);
+
+    // Successors are submitted before this job is retired, so the graphs
+    // counter can't reach zero while parts of the graph are still pending
+    job_graph *Graph = Node->Graph;
+    for (job_graph_node *Successor : Node->Successors)
+    {
+        if (Successor->PendingPredecessors.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            SubmitNamedJob(Graph->Queue, "JobGraphNode", ExecuteJobGraphNode, Successor, Graph->Counter, Graph->Priority);
+        }
+    }
+}
+
+job_graph_node *AddJobGraphNode(job_graph *Graph, job_callback Callback, void *Data)
+{
+    Graph->Nodes.emplace_back();
+    job_graph_node *Node = &Graph->Nodes.back();
+    Node->Callback = Callback;
+    Node->Data = Data;
+    Node->Graph = Graph;
+    Node->NumPredecessors = 0;
+    Node->PendingPredecessors = 0;
+    return Node;
+}
+
+void AddJobGraphDependency(job_graph_node *Before, job_graph_node *After)
+{
+    assert(Before->Graph == After->Graph);
+    Before->Successors.push_back(After);
+    ++After->NumPredecessors;
+}
+
+void SubmitJobGraph(parallel_job_queue *Queue, job_graph *Graph, job_counter *Counter, job_priority Priority)
+{
+    Graph->Queue = Queue;
+    Graph->Counter = Counter;
+    Graph->Priority = Priority;
+
+    for (auto &Node : Graph->Nodes)
+    {
+        Node.PendingPredecessors.store(Node.NumPredecessors, std::memory_order_relaxed);
+    }
+
+    // Collect the roots before submitting anything, once the first root
+    // runs the pending counts of the other nodes starts to change
+    TempArray<job_graph_node *> RootNodes(Graph->Nodes.size(), TempArray_Uninitialized);
+    size_t NumRootNodes = 0;
+    for (auto &Node : Graph->Nodes)
+    {
+        if (Node.NumPredecessors == 0)
+        {
+            RootNodes[NumRootNodes++] = &Node;
+        }
+    }
+
+    assert(!Graph->Nodes.empty() && NumRootNodes > 0);      // A graph without roots has a cycle
+    for (size_t RootIndex = 0; RootIndex < NumRootNodes; ++RootIndex)
+    {
+        SubmitNamedJob(Queue, "JobGraphNode", ExecuteJobGraphNode, RootNodes[RootIndex], Counter, Priority);
+    }
+}
+
+//
+// Parallel for
+//
+struct parallel_for_context;
+
+struct parallel_for_range
+{
+    parallel_for_context *Context;
+    uint32_t Begin;
+    uint32_t End;
+};
+
+struct parallel_for_context
+{
+    parallel_job_queue *Queue;
+    parallel_for_callback Callback;
+    void *UserContext;
+    uint32_t Grain;
+    job_priority Priority;
+    job_counter Counter;
+
+    // Every submitted range holds more than Grain/2 indices that no other
+    // range owns, which bounds the number of ranges to 2*Count/Grain + 1.
+    std::unique_ptr<parallel_for_range[]> Ranges;
+    uint32_t MaxRanges;
+    std::atomic<uint32_t> NumRanges;
+};
+
+static bool ShouldSplitRange(const parallel_for_context *Context)
+{
+    // An empty deque means nobody can steal from us, so offer half of
+    // the range. Otherwise there's already work to steal, keep going.
+    job_worker *Worker = CurrentWorker;
+    return !Worker || Worker->Queue != Context->Queue || IsDequeEmpty(&Worker->Deques[Context->Priority]);
+}
+
+static void SubmitParallelForRange(parallel_for_context *Context, uint32_t Begin, uint32_t End);
+
+static void ParallelForRangeJob(void *Data)
+{
+    parallel_for_range *Range = (parallel_for_range *)Data;
+    parallel_for_context *Context = Range->Context;
+    const uint32_t Grain = Context->Grain;
+    uint32_t Begin = Range->Begin;
+    uint32_t End = Range->End;
+
+    while (End - Begin > Grain)
+    {
+        if (ShouldSplitRange(Context))
+        {
+            const uint32_t Middle = Begin + (End - Begin) / 2;
+            SubmitParallelForRange(Context, Middle, End);
+            End = Middle;
+        }
+        else
+        {
+            Context->Callback(Context->UserContext, Begin, Begin + Grain);
+            Begin += Grain;
+        }
+    }
+
+    Context->Callback(Context->UserContext, Begin, End);
+}
+
+static void SubmitParallelForRange(parallel_for_context *Context, uint32_t Begin, uint32_t End)
+{
+    const uint32_t RangeIndex = Context->NumRanges.fetch_add(1, std::memory_order_relaxed);
+    assert(RangeIndex < Context->MaxRanges);
+
+    parallel_for_range *Range = &Context->Ranges[RangeIndex];
+    Range->Context = Context;
+    Range->Begin = Begin;
+    Range->End = End;
+    SubmitNamedJob(Context->Queue, "ParallelFor", ParallelForRangeJob, Range, &Context->Counter, Context->Priority);
+}
+
+void ParallelForRange(parallel_job_queue *Queue, uint32_t Begin, uint32_t End, uint32_t Grain, parallel_for_callback Callback, void *Context)
+{
+    if (Begin >= End)
+    {
+        return;
+    }
+
+    Grain = Grain > 0 ? Grain : 1;
+    const uint32_t Count = End - Begin;
+    if (!Queue || Queue->NumWorkers == 0 || Count <= Grain)
+    {
+        Callback(Context, Begin, End);
+        return;
+    }
+
+    parallel_for_context ForContext;
+    ForContext.Queue = Queue;
+    ForContext.Callback = Callback;
+    ForContext.UserContext = Context;
+    ForContext.Grain = Grain;
+    ForContext.Priority = GetCurrentJobPriority();
+    ForContext.MaxRanges = 2 * (Count / Grain) + 2;
+    ForContext.Ranges.reset(new parallel_for_range[ForContext.MaxRanges]);
+    ForContext.NumRanges = 0;
+
+    SubmitParallelForRange(&ForContext, Begin, End);
+    WaitForCounter(Queue, &ForContext.Counter);
 }
\ No newline at end of file
@@ -1,35 +1,242 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Base/Container/ConcurrentQueue.h"
+#include "Base/Container/SmallVector.h"
 
-#define NUM_ENTRIES_PER_QUEUE   256
+#define NUM_ENTRIES_PER_QUEUE   256         // Must be a power of two
+#define NUM_ENTRIES_PER_DEQUE   4096        // Must be a power of two
+#define JOB_THREAD_INDEX_NONE   UINT32_MAX
+#define JOB_PROCESSOR_ANY       UINT32_MAX
+#define JOB_CACHE_LINE_SIZE     64
+#define JOB_GRAPH_INLINE_SUCCESSORS 4       // Most nodes fan out to a few others, more than this allocates
 
 typedef void(*job_callback)(void *);
 
+// Workers drain the lanes in order, so frame critical jobs (culling, command
+// buffer building) never queue up behind a long texture decode. Background
+// jobs never occupy more than NumWorkers-1 workers at a time.
+enum job_priority
+{
+    JobPriority_FrameCritical,
+    JobPriority_Normal,
+    JobPriority_Background,
+    NUM_JOB_PRIORITIES
+};
+
+struct parallel_job_queue;
+struct job_counter_waiter;
+
+// Number of outstanding jobs submitted with the counter, makes it possible
+// to wait for a subset of the jobs in a queue.
+struct job_counter
+{
+    std::atomic<uint32_t> Value;
+    std::atomic<uint32_t> WaitLock;         // Guards Waiters and the transition to zero
+    job_counter_waiter *Waiters;
+
+    job_counter() : Value(0), WaitLock(0), Waiters(nullptr) {}
+};
+
 struct job_entry
 {
     job_callback Callback;
     void *Data;
-    bool Executed;
+    job_counter *Counter;
+    job_priority Priority;
+    const char *Name;                       // Shown in the debug trace, may be null
+};
+
+// A job submitted to Queue once a counter reaches zero. The waiter is owned
+// by the caller and has to stay alive until the job has been submitted.
+struct job_counter_waiter
+{
+    job_entry Entry;
+    parallel_job_queue *Queue;
+    job_counter_waiter *Next;
+};
+
+// Chase-Lev work stealing deque. The owning worker pushes and pops at the
+// bottom, other workers steal from the top. Top and Bottom are kept on
+// separate cache lines since they are written by different threads.
+struct job_deque
+{
+    std::atomic<int64_t> Top;
+    uint8_t TopPad[JOB_CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> Bottom;
+    uint8_t BottomPad[JOB_CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+
+    job_entry Entries[NUM_ENTRIES_PER_DEQUE];
+};
+
+// Jobs submitted from threads outside the queue go through a bounded
+// multi-producer/multi-consumer queue per lane, jobs submitted from inside
+// a job go to the workers own deque.
+struct job_lane
+{
+    MPMCQueue<job_entry, NUM_ENTRIES_PER_QUEUE> Ring;
+
+    // Jobs that didn't fit in the ring or a full deque spill over here, so a
+    // large burst of submissions never fails. Slow path, guarded by a lock.
+    std::mutex OverflowLock;
+    std::deque<job_entry> OverflowJobs;
+    std::atomic<uint32_t> NumOverflowJobs;
+};
+
+struct job_worker
+{
+    job_deque Deques[NUM_JOB_PRIORITIES];
+    parallel_job_queue *Queue;
+    uint32_t ThreadIndex;
+    uint32_t RandomState;                   // xorshift state used to pick steal victims
+    uint32_t ProcessorId;                   // Logical processor the thread is pinned to, or JOB_PROCESSOR_ANY
+    job_priority CurrentPriority;           // Priority of the job being executed
+    uint32_t BackgroundJobDepth;            // Nested background jobs share one background slot
+    bool RunsBackgroundJobs;
 };
 
 struct parallel_job_queue
 {
-    volatile uint32_t CompletionGoal;
-    volatile uint32_t CompletionCount;
-    volatile uint32_t NextEntryWrite;
-    volatile uint32_t NextEntryRead;
+    std::atomic<uint32_t> CompletionGoal;
+    std::atomic<uint32_t> CompletionCount;
+
+    job_lane Lanes[NUM_JOB_PRIORITIES];
 
-    job_entry JobEntries[NUM_ENTRIES_PER_QUEUE];
-    void *SemaphoreHandle;
+    // One slot per worker thread plus a last slot for the thread that
+    // created the queue, which runs jobs while it waits on the queue
+    std::unique_ptr<job_worker[]> Workers;
+    uint32_t NumWorkers;
+    uint32_t NumWorkerSlots;
+
+    // Workers currently running a background job, kept below the worker
+    // count so there's always a core left for frame critical work
+    std::atomic<uint32_t> NumActiveBackgroundJobs;
+    uint32_t MaxBackgroundJobs;
+
+    // Idle workers park on WorkAvailable, waiters park on QueueFinished.
+    // The sleeper counts lets SubmitJob skip the lock when nobody is parked.
+    std::mutex ParkingLock;
+    std::condition_variable WorkAvailable;
+    std::condition_variable QueueFinished;
+    std::atomic<uint32_t> NumSleepingWorkers;
+    std::atomic<uint32_t> NumSleepingHelpers;   // Waiters that want to run new jobs
+    std::atomic<bool> ShutdownRequested;
+
+    std::vector<std::thread> WorkerThreads;
 };
 
-void CreateParallelJobQueue(parallel_job_queue *Queue, uint32_t NumThreads);
-void SubmitJob(parallel_job_queue *Queue, job_callback Callback, void *Data);
+// With ProcessorIds set, worker i is pinned to logical processor ProcessorIds[i].
+// The calling thread joins the queue as an extra worker while it waits in
+// WaitForQueueToFinish or WaitForCounter, but never runs background jobs.
+void CreateParallelJobQueue(parallel_job_queue *Queue, uint32_t NumThreads, const uint32_t *ProcessorIds = nullptr);
+void DestroyParallelJobQueue(parallel_job_queue *Queue);
+void SubmitJob(parallel_job_queue *Queue, job_callback Callback, void *Data, job_counter *Counter = nullptr, job_priority Priority = JobPriority_Normal);
+
+// Same as SubmitJob, Name labels the job in the debug trace (see DebugEnableTrace)
+// and has to stay valid until the trace is saved.
+void SubmitNamedJob(parallel_job_queue *Queue, const char *Name, job_callback Callback, void *Data, job_counter *Counter = nullptr, job_priority Priority = JobPriority_Normal);
 void WaitForQueueToFinish(parallel_job_queue *Queue);
 
-inline uint32_t GetThreadID(void)
+// Block until all jobs submitted with Counter has finished. Workers and the
+// thread that created the queue run other jobs while waiting.
+void WaitForCounter(parallel_job_queue *Queue, job_counter *Counter);
+
+// True once Counter is zero and the thread that took it there is done with
+// it, from then on the counter can be destroyed.
+bool IsJobCounterDone(const job_counter *Counter);
+
+// Manual counter handling for work that isn't a single job, like a coroutine
+// that runs over several jobs. SubmitJob/ExecuteJob does this for plain jobs.
+void IncrementJobCounter(job_counter *Counter, uint32_t Amount = 1);
+void DecrementJobCounter(parallel_job_queue *Queue, job_counter *Counter);
+
+// Register Waiter to be submitted when Counter reaches zero. Returns false
+// without registering if the counter already is zero. Waiter->Queue has to
+// be set, it's also the queue whose waiters are woken if registering fails.
+bool AddJobCounterWaiter(job_counter *Counter, job_counter_waiter *Waiter);
+
+// A set of jobs where each job is submitted once all of its predecessors
+// has finished. Nodes are owned by the graph and keep their address for
+// the graphs lifetime, a graph can be submitted again once it's finished.
+//
+// Usage example:
+//  job_graph Graph;
+//  job_graph_node *Load = AddJobGraphNode(&Graph, LoadModelJob, &Model);
+//  job_graph_node *Decode = AddJobGraphNode(&Graph, DecodeTexturesJob, &Model);
+//  job_graph_node *Upload = AddJobGraphNode(&Graph, UploadJob, &Model);
+//  AddJobGraphDependency(Load, Upload);
+//  AddJobGraphDependency(Decode, Upload);
+//
+//  job_counter Counter;
+//  SubmitJobGraph(&Queue, &Graph, &Counter);
+//  WaitForCounter(&Queue, &Counter);
+//
+struct job_graph;
+
+struct job_graph_node
+{
+    job_callback Callback;
+    void *Data;
+    job_graph *Graph;
+    uint32_t NumPredecessors;
+    std::atomic<uint32_t> PendingPredecessors;
+    SmallVector<job_graph_node *, JOB_GRAPH_INLINE_SUCCESSORS> Successors;
+};
+
+struct job_graph
 {
-    uint8_t *threadLocalStorage = (uint8_t *)__readgsqword(0x30);
-    uint32_t threadID = *(uint32_t *)(threadLocalStorage + 0x48);
+    std::deque<job_graph_node> Nodes;
+    parallel_job_queue *Queue;
+    job_counter *Counter;
+    job_priority Priority;
+};
+
+job_graph_node *AddJobGraphNode(job_graph *Graph, job_callback Callback, void *Data);
+void AddJobGraphDependency(job_graph_node *Before, job_graph_node *After);
+void SubmitJobGraph(parallel_job_queue *Queue, job_graph *Graph, job_counter *Counter = nullptr, job_priority Priority = JobPriority_Normal);
+
+// Run Callback over [Begin, End) in chunks of at most Grain indices and wait
+// for it to finish. Ranges are split in half recursively while the running
+// worker's deque is empty, so idle workers always have something to steal
+// while a busy pool just runs large chunks without splitting overhead.
+// The ranges run at the priority of the calling job.
+typedef void(*parallel_for_callback)(void *Context, uint32_t Begin, uint32_t End);
+void ParallelForRange(parallel_job_queue *Queue, uint32_t Begin, uint32_t End, uint32_t Grain, parallel_for_callback Callback, void *Context);
+
+// Usage example:
+//  ParallelFor(GlobalJobQueue, 0, (uint32_t)vertices.size(), 1024, [&](uint32_t index)
+//  {
+//      vertices[index].normal = Normalize(vertices[index].normal);
+//  });
+//
+template <typename Function>
+void ParallelFor(parallel_job_queue *Queue, uint32_t Begin, uint32_t End, uint32_t Grain, const Function &Body)
+{
+    parallel_for_callback Callback = [](void *Context, uint32_t RangeBegin, uint32_t RangeEnd)
+    {
+        const Function &Body = *(const Function *)Context;
+        for (uint32_t Index = RangeBegin; Index < RangeEnd; ++Index)
+        {
+            Body(Index);
+        }
+    };
+
+    ParallelForRange(Queue, Begin, End, Grain, Callback, (void *)&Body);
+}
+
+// Index of the calling worker thread, or JOB_THREAD_INDEX_NONE if called
+// from a thread not owned by a job queue. The thread that created the queue
+// has index NumWorkers.
+uint32_t GetJobThreadIndex();
+
+// Priority of the job running on the calling thread, JobPriority_Normal if
+// called from outside a job.
+job_priority GetCurrentJobPriority();
 
-    return threadID;
-}
\ No newline at end of file
+// Engine wide job queue, created by RunGameApplication.
+extern parallel_job_queue *GlobalJobQueue;
\ No newline at end of file
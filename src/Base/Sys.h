@@ -11,11 +11,42 @@ struct Sys_ProcessorInfo
     uint32_t cacheSizeK;
 };
 
+#define SYS_MAX_LOGICAL_PROCESSORS  256
+
+// Logical processor numbers ordered so that the first numCores entries are
+// on distinct physical cores, the SMT siblings of those cores follow.
+// coreIndices holds the index of the core of each entry, the core index of
+// the first numCores entries is their own index.
+struct Sys_ProcessorTopology
+{
+    uint32_t numCores;
+    uint32_t numLogicalProcessors;
+    uint32_t logicalProcessors[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t coreIndices[SYS_MAX_LOGICAL_PROCESSORS];
+};
+
+// Back reserved memory with huge pages where the system supports it
+#define SYS_RESERVE_HUGE_PAGES      0x1
+
 void *Sys_Alloc(uint64_t size);
 void Sys_Free(void *address);
 
+// Reserve address space without committing any memory to it, ranges have
+// to be committed with Sys_Commit before they are used. Released with
+// Sys_Free. The memory tracking counts committed bytes under the tag of
+// the committing thread, a range committed twice is counted twice.
+void *Sys_Reserve(uint64_t size, uint32_t flags = 0);
+bool Sys_Commit(void *address, uint64_t size);
+uint64_t Sys_GetPageSize();
+
+// Physical memory currently used by the process, or 0 if it's unknown.
+// Reserved but uncommitted memory and untouched pages don't count.
+uint64_t Sys_GetProcessResidentBytes();
+
 std::vector<std::string> Sys_GetGraphicCardList();       // TODO: Make C-API-able-isch
 void Sys_GetProcessorInfo(Sys_ProcessorInfo *info);
+void Sys_GetProcessorTopology(Sys_ProcessorTopology *topology);
+bool Sys_SetCurrentThreadAffinity(uint32_t logicalProcessor);
 
 void Sys_VPrintf(const char *fmt, va_list args);
 void Sys_Printf(const char *fmt, ...);
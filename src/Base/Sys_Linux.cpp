@@ -0,0 +1,464 @@
+#include "Precompiled.h"
+#include "Base/Sys.h"
+#include "Base/Debug.h"
+#include "Base/Memory.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#define PRINT_BUFFER_LENGTH     4096
+#define ALLOCATION_HEADER_SIZE  4096        // One page, keeps the returned address page aligned
+#define HUGE_PAGE_SIZE          (2 * 1024 * 1024)
+
+// Kept in the header page in front of every block. Reserved blocks are
+// linked together so Sys_Commit can find the block an address belongs to
+// and count the committed bytes by memory tag, Sys_Free takes them off again.
+struct allocation_header
+{
+    uint64_t mappingSize;
+    uint64_t trackedSize;
+    uint32_t tag;
+    bool isReserved;
+    uint8_t *blockStart;
+    uint8_t *blockEnd;
+    allocation_header *nextReserved;
+    uint64_t committedBytes[MemoryTag_Count];
+};
+
+static std::mutex reservedBlocksLock;
+static allocation_header *reservedBlocks = nullptr;
+
+static void *MapMemory(uint64_t size, uint32_t flags, bool commit)
+{
+    // Huge page backed regions have to start on a huge page boundary, map
+    // enough to align the block and unmap what's left over on both sides
+    const uint64_t pageSize = Sys_GetPageSize();
+    const uint64_t alignment = (flags & SYS_RESERVE_HUGE_PAGES) ? HUGE_PAGE_SIZE : pageSize;
+    const uint64_t blockSize = (size + pageSize - 1) & ~(pageSize - 1);
+    const uint64_t reservedSize = ALLOCATION_HEADER_SIZE + blockSize + (alignment - pageSize);
+
+    const int protection = commit ? (PROT_READ | PROT_WRITE) : PROT_NONE;
+    const int mapFlags = MAP_PRIVATE | MAP_ANONYMOUS | (commit ? 0 : MAP_NORESERVE);
+    uint8_t *reserved = (uint8_t *)mmap(nullptr, reservedSize, protection, mapFlags, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    uint8_t *address = (uint8_t *)(((uintptr_t)reserved + ALLOCATION_HEADER_SIZE + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    uint8_t *mapping = address - ALLOCATION_HEADER_SIZE;
+    uint8_t *mappingEnd = address + blockSize;
+    if (mapping > reserved)
+    {
+        munmap(reserved, mapping - reserved);
+    }
+
+    if (mappingEnd < reserved + reservedSize)
+    {
+        munmap(mappingEnd, reserved + reservedSize - mappingEnd);
+    }
+
+    // munmap needs the size, store it in a header page in front of the block
+    // together with the memory tag
+    if (!commit)
+    {
+        mprotect(mapping, ALLOCATION_HEADER_SIZE, PROT_READ | PROT_WRITE);
+    }
+
+    if (flags & SYS_RESERVE_HUGE_PAGES)
+    {
+        madvise(address, blockSize, MADV_HUGEPAGE);
+    }
+
+    // Reserved memory is counted when it's committed, until then only the
+    // header page is in use
+    allocation_header *header = (allocation_header *)mapping;
+    header->mappingSize = mappingEnd - mapping;
+    header->trackedSize = commit ? size : ALLOCATION_HEADER_SIZE;
+    header->tag = TrackAllocation(header->trackedSize);
+    header->isReserved = !commit;
+    header->blockStart = address;
+    header->blockEnd = address + size;
+    if (!commit)
+    {
+        std::lock_guard<std::mutex> guard(reservedBlocksLock);
+        header->nextReserved = reservedBlocks;
+        reservedBlocks = header;
+    }
+
+    return address;
+}
+
+void *Sys_Alloc(uint64_t size)
+{
+    return MapMemory(size, 0, true);
+}
+
+void *Sys_Reserve(uint64_t size, uint32_t flags)
+{
+    return MapMemory(size, flags, false);
+}
+
+bool Sys_Commit(void *address, uint64_t size)
+{
+    const uint64_t pageSize = Sys_GetPageSize();
+    const uintptr_t start = (uintptr_t)address & ~(uintptr_t)(pageSize - 1);
+    const uintptr_t end = ((uintptr_t)address + size + pageSize - 1) & ~(uintptr_t)(pageSize - 1);
+    if (mprotect((void *)start, end - start, PROT_READ | PROT_WRITE) != 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(reservedBlocksLock);
+    for (allocation_header *header = reservedBlocks; header; header = header->nextReserved)
+    {
+        if ((uint8_t *)address >= header->blockStart && (uint8_t *)address < header->blockEnd)
+        {
+            header->committedBytes[TrackAllocation(size)] += size;
+            break;
+        }
+    }
+
+    return true;
+}
+
+uint64_t Sys_GetPageSize()
+{
+    static const uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+uint64_t Sys_GetProcessResidentBytes()
+{
+    // Second field of statm is the resident set in pages
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+    {
+        return 0;
+    }
+
+    unsigned long long totalPages = 0;
+    unsigned long long residentPages = 0;
+    const int numRead = fscanf(statm, "%llu %llu", &totalPages, &residentPages);
+    fclose(statm);
+    return (numRead == 2) ? residentPages * Sys_GetPageSize() : 0;
+}
+
+void Sys_Free(void *address)
+{
+    if (address)
+    {
+        void *mapping = (uint8_t *)address - ALLOCATION_HEADER_SIZE;
+        allocation_header *header = (allocation_header *)mapping;
+        if (header->isReserved)
+        {
+            std::lock_guard<std::mutex> guard(reservedBlocksLock);
+            allocation_header **link = &reservedBlocks;
+            while (*link != header)
+            {
+                link = &(*link)->nextReserved;
+            }
+
+            *link = header->nextReserved;
+            for (uint32_t tag = 0; tag < MemoryTag_Count; ++tag)
+            {
+                TrackFree((memory_tag)tag, header->committedBytes[tag]);
+            }
+        }
+
+        TrackFree((memory_tag)header->tag, header->trackedSize);
+        munmap(mapping, header->mappingSize);
+    }
+}
+
+std::vector<std::string> Sys_GetGraphicCardList()
+{
+    // There's no device string without a GL context, report the PCI ids
+    std::vector<std::string> gpus;
+    for (uint32_t cardNum = 0; cardNum < 8; ++cardNum)
+    {
+        char path[128];
+        uint32_t vendorId = 0;
+        uint32_t deviceId = 0;
+
+        snprintf(path, sizeof(path), "/sys/class/drm/card%u/device/vendor", cardNum);
+        FILE *file = fopen(path, "r");
+        if (!file)
+        {
+            continue;
+        }
+        fscanf(file, "%x", &vendorId);
+        fclose(file);
+
+        snprintf(path, sizeof(path), "/sys/class/drm/card%u/device/device", cardNum);
+        file = fopen(path, "r");
+        if (file)
+        {
+            fscanf(file, "%x", &deviceId);
+            fclose(file);
+        }
+
+        char deviceString[64];
+        snprintf(deviceString, sizeof(deviceString), "PCI %04x:%04x", vendorId, deviceId);
+        gpus.push_back(std::string(deviceString));
+    }
+
+    return gpus;
+}
+
+void Sys_GetProcessorInfo(Sys_ProcessorInfo *info)
+{
+    static char cpuBrandString[0x40] = "Unknown";
+    info->cacheLineSize = 64;
+    info->L2Associativity = 0;
+    info->cacheSizeK = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int cpuInfo[4] = {};
+    if (__get_cpuid(0x80000004, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]))
+    {
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            __get_cpuid(0x80000002 + i, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]);
+            memcpy(cpuBrandString + i*16, cpuInfo, sizeof(cpuInfo));
+        }
+        cpuBrandString[sizeof(cpuBrandString) - 1] = '\0';
+    }
+
+    if (__get_cpuid(0x80000006, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]))
+    {
+        info->cacheLineSize = cpuInfo[2] & 0xff;
+        info->L2Associativity = (cpuInfo[2] >> 12) & 0xf;
+        info->cacheSizeK = (cpuInfo[2] >> 16) & 0xffff;
+    }
+#endif
+
+    // cpu brand string is sometimes prefixed with spaces, skip those
+    intptr_t brandStringBeginIndex = 0;
+    while (*(cpuBrandString + brandStringBeginIndex) == ' ') ++brandStringBeginIndex;
+    info->cpuString = cpuBrandString + brandStringBeginIndex;
+
+    // sysfs knows about every package, cpuid only about the current one
+    Sys_ProcessorTopology topology;
+    Sys_GetProcessorTopology(&topology);
+    info->numLogicalProcessors = topology.numLogicalProcessors;
+    info->numCores = topology.numCores;
+}
+
+static bool ReadSysfsValue(const char *path, uint32_t *value)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool succeeded = (fscanf(file, "%u", value) == 1);
+    fclose(file);
+    return succeeded;
+}
+
+// Parse a sysfs cpu list like "0-3,8,10-11"
+static uint32_t ParseCpuList(const char *list, uint32_t *cpus, uint32_t maxCpus)
+{
+    uint32_t numCpus = 0;
+    const char *it = list;
+    while (*it >= '0' && *it <= '9')
+    {
+        char *end = nullptr;
+        uint32_t first = (uint32_t)strtoul(it, &end, 10);
+        uint32_t last = first;
+        if (*end == '-')
+        {
+            last = (uint32_t)strtoul(end + 1, &end, 10);
+        }
+
+        for (uint32_t cpu = first; cpu <= last && numCpus < maxCpus; ++cpu)
+        {
+            cpus[numCpus++] = cpu;
+        }
+
+        it = (*end == ',') ? end + 1 : end;
+    }
+
+    return numCpus;
+}
+
+void Sys_GetProcessorTopology(Sys_ProcessorTopology *topology)
+{
+    uint32_t cpus[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t numCpus = 0;
+
+    FILE *file = fopen("/sys/devices/system/cpu/online", "r");
+    if (file)
+    {
+        char cpuList[1024] = {};
+        if (fgets(cpuList, sizeof(cpuList), file))
+        {
+            numCpus = ParseCpuList(cpuList, cpus, SYS_MAX_LOGICAL_PROCESSORS);
+        }
+        fclose(file);
+    }
+
+    if (numCpus == 0)
+    {
+        long numOnline = sysconf(_SC_NPROCESSORS_ONLN);
+        numCpus = numOnline > 0 ? (uint32_t)numOnline : 1;
+        numCpus = numCpus < SYS_MAX_LOGICAL_PROCESSORS ? numCpus : SYS_MAX_LOGICAL_PROCESSORS;
+        for (uint32_t i = 0; i < numCpus; ++i)
+        {
+            cpus[i] = i;
+        }
+    }
+
+    // A core is identified by its package and core id, the first cpu seen
+    // for a core is used as its primary thread and the rest are siblings
+    uint32_t packageIds[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t coreIds[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t siblings[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t siblingCores[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t numSiblings = 0;
+    topology->numCores = 0;
+
+    for (uint32_t i = 0; i < numCpus; ++i)
+    {
+        char path[128];
+        uint32_t packageId = 0;
+        uint32_t coreId = cpus[i];
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpus[i]);
+        ReadSysfsValue(path, &packageId);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpus[i]);
+        ReadSysfsValue(path, &coreId);
+
+        uint32_t siblingCore = topology->numCores;
+        for (uint32_t core = 0; core < topology->numCores; ++core)
+        {
+            if (packageIds[core] == packageId && coreIds[core] == coreId)
+            {
+                siblingCore = core;
+                break;
+            }
+        }
+
+        if (siblingCore != topology->numCores)
+        {
+            siblingCores[numSiblings] = siblingCore;
+            siblings[numSiblings++] = cpus[i];
+        }
+        else
+        {
+            packageIds[topology->numCores] = packageId;
+            coreIds[topology->numCores] = coreId;
+            topology->coreIndices[topology->numCores] = topology->numCores;
+            topology->logicalProcessors[topology->numCores++] = cpus[i];
+        }
+    }
+
+    memcpy(&topology->logicalProcessors[topology->numCores], siblings, numSiblings * sizeof(uint32_t));
+    memcpy(&topology->coreIndices[topology->numCores], siblingCores, numSiblings * sizeof(uint32_t));
+    topology->numLogicalProcessors = topology->numCores + numSiblings;
+}
+
+bool Sys_SetCurrentThreadAffinity(uint32_t logicalProcessor)
+{
+    if (logicalProcessor >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(logicalProcessor, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+void Sys_VPrintf(const char *fmt, va_list args)
+{
+    char msg[PRINT_BUFFER_LENGTH];
+
+    vsnprintf(msg, PRINT_BUFFER_LENGTH - 1, fmt, args);
+    msg[PRINT_BUFFER_LENGTH - 1] = '\0';
+    fputs(msg, stdout);
+}
+
+void Sys_Printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Sys_VPrintf(fmt, args);
+    va_end(args);
+}
+
+void Sys_ErrorPrintf(const char *fmt, ...)
+{
+    char msg[PRINT_BUFFER_LENGTH];
+    char msgWithPrefix[PRINT_BUFFER_LENGTH];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, PRINT_BUFFER_LENGTH - 1, fmt, args);
+    msg[PRINT_BUFFER_LENGTH - 1] = '\0';
+    va_end(args);
+
+    snprintf(msgWithPrefix, PRINT_BUFFER_LENGTH - 1, "*** Error: %s", msg);
+    msgWithPrefix[PRINT_BUFFER_LENGTH - 1] = '\0';
+
+    fputs(msgWithPrefix, stderr);
+    DebugAddMessageToBuffer(msgWithPrefix);
+}
+
+uint64_t Sys_GetClockTicks()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+uint64_t Sys_GetClockTicksPerSecond()
+{
+    return 1000000000ull;
+}
+
+void Sys_Sleep(uint32_t milliseconds)
+{
+    timespec time;
+    time.tv_sec = milliseconds / 1000;
+    time.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+    while (nanosleep(&time, &time) != 0 && errno == EINTR)
+    {
+    }
+}
+
+uint32_t AtomicCompareExchangeUInt32(uint32_t volatile *value, uint32_t exchange, uint32_t compareand)
+{
+    uint32_t result = __sync_val_compare_and_swap(value, compareand, exchange);
+    return result;
+}
+
+uint64_t AtomicCompareExchangeUInt64(uint64_t volatile *value, uint64_t exchange, uint64_t compareand)
+{
+    uint64_t result = __sync_val_compare_and_swap(value, compareand, exchange);
+    return result;
+}
+
+uint32_t AtomicAddUint32(uint32_t volatile *value, uint32_t addend)
+{
+    uint32_t result = __sync_fetch_and_add(value, addend);
+    return result;
+}
+
+uint64_t AtomicAddUint64(uint64_t volatile *value, uint64_t addend)
+{
+    uint64_t result = __sync_fetch_and_add(value, addend);
+    return result;
+}
\ No newline at end of file
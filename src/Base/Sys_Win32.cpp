@@ -1,19 +1,136 @@
 #include "Precompiled.h"
 #include "Base/Sys.h"
 #include "Base/Debug.h"
+#include "Base/Memory.h"
 #include <Windows.h>
+#include <Psapi.h>
+#include <mutex>
 
 #define PRINT_BUFFER_LENGTH     4096
+#define ALLOCATION_HEADER_SIZE  4096        // One page, keeps the returned address page aligned
+
+// Kept in the header page in front of every block. Reserved blocks are
+// linked together so Sys_Commit can find the block an address belongs to
+// and count the committed bytes by memory tag, Sys_Free takes them off again.
+struct allocation_header
+{
+    uint64_t trackedSize;
+    uint32_t tag;
+    bool isReserved;
+    uint8_t *blockStart;
+    uint8_t *blockEnd;
+    allocation_header *nextReserved;
+    uint64_t committedBytes[MemoryTag_Count];
+};
+
+static std::mutex reservedBlocksLock;
+static allocation_header *reservedBlocks = nullptr;
 
 void *Sys_Alloc(uint64_t size)
 {
-    void *result = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    return result;
+    void *result = VirtualAlloc(0, size + ALLOCATION_HEADER_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!result)
+    {
+        return nullptr;
+    }
+
+    allocation_header *header = (allocation_header *)result;
+    header->trackedSize = size;
+    header->tag = TrackAllocation(size);
+    header->isReserved = false;
+    header->blockStart = (uint8_t *)result + ALLOCATION_HEADER_SIZE;
+    header->blockEnd = header->blockStart + size;
+    return header->blockStart;
+}
+
+void *Sys_Reserve(uint64_t size, uint32_t /*flags*/)
+{
+    // Large pages need SeLockMemoryPrivilege and have to be committed up
+    // front, so SYS_RESERVE_HUGE_PAGES is ignored
+    void *result = VirtualAlloc(0, size + ALLOCATION_HEADER_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+    if (!result || !VirtualAlloc(result, ALLOCATION_HEADER_SIZE, MEM_COMMIT, PAGE_READWRITE))
+    {
+        return nullptr;
+    }
+
+    // Reserved memory is counted when it's committed, until then only the
+    // header page is in use
+    allocation_header *header = (allocation_header *)result;
+    header->trackedSize = ALLOCATION_HEADER_SIZE;
+    header->tag = TrackAllocation(ALLOCATION_HEADER_SIZE);
+    header->isReserved = true;
+    header->blockStart = (uint8_t *)result + ALLOCATION_HEADER_SIZE;
+    header->blockEnd = header->blockStart + size;
+
+    std::lock_guard<std::mutex> guard(reservedBlocksLock);
+    header->nextReserved = reservedBlocks;
+    reservedBlocks = header;
+    return header->blockStart;
+}
+
+bool Sys_Commit(void *address, uint64_t size)
+{
+    if (!VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(reservedBlocksLock);
+    for (allocation_header *header = reservedBlocks; header; header = header->nextReserved)
+    {
+        if ((uint8_t *)address >= header->blockStart && (uint8_t *)address < header->blockEnd)
+        {
+            header->committedBytes[TrackAllocation(size)] += size;
+            break;
+        }
+    }
+
+    return true;
+}
+
+uint64_t Sys_GetPageSize()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+}
+
+uint64_t Sys_GetProcessResidentBytes()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+
+    return counters.WorkingSetSize;
 }
 
 void Sys_Free(void *address)
 {
-    VirtualFree(address, 0, MEM_RELEASE);
+    if (address)
+    {
+        void *result = (uint8_t *)address - ALLOCATION_HEADER_SIZE;
+        allocation_header *header = (allocation_header *)result;
+        if (header->isReserved)
+        {
+            std::lock_guard<std::mutex> guard(reservedBlocksLock);
+            allocation_header **link = &reservedBlocks;
+            while (*link != header)
+            {
+                link = &(*link)->nextReserved;
+            }
+
+            *link = header->nextReserved;
+            for (uint32_t tag = 0; tag < MemoryTag_Count; ++tag)
+            {
+                TrackFree((memory_tag)tag, header->committedBytes[tag]);
+            }
+        }
+
+        TrackFree((memory_tag)header->tag, header->trackedSize);
+        VirtualFree(result, 0, MEM_RELEASE);
+    }
 }
 
 std::vector<std::string> Sys_GetGraphicCardList()
@@ -65,6 +182,81 @@ void Sys_GetProcessorInfo(Sys_ProcessorInfo *info)
     info->numCores = (cpuInfo[0] >> 26) + 1;
 }
 
+void Sys_GetProcessorTopology(Sys_ProcessorTopology *topology)
+{
+    topology->numCores = 0;
+    topology->numLogicalProcessors = 0;
+
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> processorInfo(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!processorInfo.empty() && GetLogicalProcessorInformation(processorInfo.data(), &length))
+    {
+        // First processor of each core goes to the front, siblings are
+        // appended after all cores are known
+        uint32_t siblings[SYS_MAX_LOGICAL_PROCESSORS];
+        uint32_t siblingCores[SYS_MAX_LOGICAL_PROCESSORS];
+        uint32_t numSiblings = 0;
+        for (const auto &info : processorInfo)
+        {
+            if (info.Relationship != RelationProcessorCore)
+            {
+                continue;
+            }
+
+            bool isFirstInCore = true;
+            for (uint32_t processor = 0; processor < sizeof(ULONG_PTR) * 8; ++processor)
+            {
+                if (!(info.ProcessorMask & ((ULONG_PTR)1 << processor)))
+                {
+                    continue;
+                }
+
+                if (isFirstInCore)
+                {
+                    topology->coreIndices[topology->numCores] = topology->numCores;
+                    topology->logicalProcessors[topology->numCores++] = processor;
+                    isFirstInCore = false;
+                }
+                else
+                {
+                    siblingCores[numSiblings] = topology->numCores - 1;
+                    siblings[numSiblings++] = processor;
+                }
+            }
+        }
+
+        memcpy(&topology->logicalProcessors[topology->numCores], siblings, numSiblings * sizeof(uint32_t));
+        memcpy(&topology->coreIndices[topology->numCores], siblingCores, numSiblings * sizeof(uint32_t));
+        topology->numLogicalProcessors = topology->numCores + numSiblings;
+    }
+
+    if (topology->numCores == 0)
+    {
+        // Unknown topology, treat every logical processor as a core
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        topology->numCores = systemInfo.dwNumberOfProcessors > 0 ? systemInfo.dwNumberOfProcessors : 1;
+        topology->numLogicalProcessors = topology->numCores;
+        for (uint32_t i = 0; i < topology->numCores; ++i)
+        {
+            topology->logicalProcessors[i] = i;
+            topology->coreIndices[i] = i;
+        }
+    }
+}
+
+bool Sys_SetCurrentThreadAffinity(uint32_t logicalProcessor)
+{
+    // Processors outside the first processor group can't be set with a mask
+    if (logicalProcessor >= sizeof(DWORD_PTR) * 8)
+    {
+        return false;
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << logicalProcessor) != 0;
+}
+
 void Sys_VPrintf(const char *fmt, va_list args)
 {
     char msg[PRINT_BUFFER_LENGTH];
@@ -25,7 +25,7 @@ std::string TimeStringNano(uint64_t nanos)
     double time = (double)nanos;
     uint16_t divCount = 0;
 
-    while (time > 100.0 && divCount < _countof(timePrefix))
+    while (time > 100.0 && divCount + 1 < sizeof(timePrefix) / sizeof(timePrefix[0]))
     {
         time /= 1000.0;
         divCount++;
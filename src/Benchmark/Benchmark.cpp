@@ -0,0 +1,114 @@
+#include "Precompiled.h"
+#include "Benchmark/Benchmark.h"
+#include "Base/Sys.h"
+#include "Base/Timer.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static volatile uintptr_t BenchmarkSink;
+
+bool ShouldRunBenchmark(const benchmark_context *Context, const char *Name)
+{
+    return !Context->Filter || strstr(Name, Context->Filter) != nullptr;
+}
+
+void PrintBenchmarkSection(const char *Title)
+{
+    Sys_Printf("\n--------< %s >----------------------------------------------------------------\n", Title);
+}
+
+benchmark_timer BeginBenchmark(const char *Name)
+{
+    benchmark_timer Timer;
+    Timer.Name = Name;
+    Timer.StartResidentBytes = Sys_GetProcessResidentBytes();
+    Timer.StartNanos = HiPerformanceTimer::GetTicksNanos();
+    return Timer;
+}
+
+void EndBenchmark(const benchmark_timer *Timer, uint64_t NumOps)
+{
+    const uint64_t ElapsedNanos = HiPerformanceTimer::GetTicksNanos() - Timer->StartNanos;
+    const uint64_t ResidentBytes = Sys_GetProcessResidentBytes();
+    const double NanosPerOp = NumOps ? (double)ElapsedNanos / (double)NumOps : 0.0;
+    const double ResidentMegabytes = (double)ResidentBytes / (1024.0 * 1024.0);
+    const double ResidentChange = ((double)ResidentBytes - (double)Timer->StartResidentBytes) / (1024.0 * 1024.0);
+
+    Sys_Printf("%-52s %10.1f ns/op %12llu ops   RSS %8.1f MB (%+.1f MB)\n",
+               Timer->Name,
+               NanosPerOp,
+               (unsigned long long)NumOps,
+               ResidentMegabytes,
+               ResidentChange);
+}
+
+void PrintBenchmarkResult(const char *Name, const char *Format, ...)
+{
+    char Result[256];
+    va_list Args;
+    va_start(Args, Format);
+    vsnprintf(Result, sizeof(Result), Format, Args);
+    va_end(Args);
+
+    Sys_Printf("%-52s %s\n", Name, Result);
+}
+
+void BenchmarkUse(const void *Pointer)
+{
+    BenchmarkSink = (uintptr_t)Pointer;
+}
+
+static void PrintUsage()
+{
+    Sys_Printf("Usage: CybBench [-filter <name>] [-threads <count>] [-repeat <count>]\n");
+    Sys_Printf("  -filter   only run benchmarks with names containing <name>\n");
+    Sys_Printf("  -threads  highest thread count for multithreaded benchmarks (default: logical processors)\n");
+    Sys_Printf("  -repeat   multiply the operation counts, for steadier numbers (default: 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+    Sys_ProcessorTopology Topology;
+    Sys_GetProcessorTopology(&Topology);
+
+    benchmark_context Context = {};
+    Context.Filter = nullptr;
+    Context.MaxThreads = Topology.numLogicalProcessors;
+    Context.Repeat = 1;
+
+    for (int Arg = 1; Arg < argc; ++Arg)
+    {
+        const bool HasValue = Arg + 1 < argc;
+        if (HasValue && !strcmp(argv[Arg], "-filter"))
+        {
+            Context.Filter = argv[++Arg];
+        }
+        else if (HasValue && !strcmp(argv[Arg], "-threads"))
+        {
+            const int MaxThreads = atoi(argv[++Arg]);
+            Context.MaxThreads = MaxThreads > 0 ? (uint32_t)MaxThreads : 1;
+        }
+        else if (HasValue && !strcmp(argv[Arg], "-repeat"))
+        {
+            const int Repeat = atoi(argv[++Arg]);
+            Context.Repeat = Repeat > 0 ? (uint32_t)Repeat : 1;
+        }
+        else
+        {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    Sys_Printf("CybBench: %u cores, %u logical processors, up to %u threads\n",
+               Topology.numCores,
+               Topology.numLogicalProcessors,
+               Context.MaxThreads);
+
+    RunMemoryBenchmarks(&Context);
+    RunJobQueueBenchmarks(&Context);
+    RunQueueBenchmarks(&Context);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+
+// Harness of the CybBench console program. A benchmark times a number of
+// operations and reports the nanoseconds per operation together with the
+// resident memory of the process, so allocator and scheduler changes are
+// compared by running the same build before and after on one machine.
+//
+// Usage example:
+//  if (ShouldRunBenchmark(Context, "malloc/churn"))
+//  {
+//      benchmark_timer Timer = BeginBenchmark("malloc/churn");
+//      for (uint32_t Op = 0; Op < NumOps; ++Op)
+//          ...
+//      EndBenchmark(&Timer, NumOps);
+//  }
+//
+struct benchmark_context
+{
+    const char *Filter;                 // Only run benchmarks with names containing this, null runs all
+    uint32_t MaxThreads;                // Upper thread count for benchmarks that scale over threads
+    uint32_t Repeat;                    // Multiplier for the operation counts, longer runs are steadier
+};
+
+struct benchmark_timer
+{
+    const char *Name;
+    uint64_t StartNanos;
+    uint64_t StartResidentBytes;
+};
+
+bool ShouldRunBenchmark(const benchmark_context *Context, const char *Name);
+void PrintBenchmarkSection(const char *Title);
+
+benchmark_timer BeginBenchmark(const char *Name);
+
+// Prints ns/op for NumOps operations since BeginBenchmark, and the resident
+// memory with the change since BeginBenchmark.
+void EndBenchmark(const benchmark_timer *Timer, uint64_t NumOps);
+
+// For results that aren't a time per operation, like latencies.
+void PrintBenchmarkResult(const char *Name, const char *Format, ...);
+
+// Keeps the compiler from optimizing away work whose result is unused.
+void BenchmarkUse(const void *Pointer);
+
+// Suites, one per source file
+void RunMemoryBenchmarks(const benchmark_context *Context);
+void RunJobQueueBenchmarks(const benchmark_context *Context);
+void RunQueueBenchmarks(const benchmark_context *Context);
\ No newline at end of file
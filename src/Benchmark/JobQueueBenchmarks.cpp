@@ -0,0 +1,234 @@
+#include "Precompiled.h"
+#include "Benchmark/Benchmark.h"
+#include "Base/ParallelJobQueue.h"
+#include "Base/Timer.h"
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define SCALING_ROUNDS              256
+#define SCALING_SPAWNERS            32
+#define SCALING_JOBS_PER_SPAWNER    128
+#define SCALING_SUBMITTED_JOBS      128         // Per round, below NUM_ENTRIES_PER_QUEUE
+#define TINY_JOB_ITERATIONS         32
+#define LATENCY_FRAMES              50
+#define LATENCY_JOBS_PER_FRAME      16
+#define LATENCY_FRAME_JOB_MICROS    50
+#define LATENCY_BACKGROUND_JOBS     400
+#define LATENCY_BACKGROUND_ITEMS    64          // ParallelFor items in every background job
+#define LATENCY_BACKGROUND_MICROS   20          // Per item
+
+struct scaling_spawner
+{
+    parallel_job_queue *Queue;
+    uint32_t Seed;
+};
+
+// A few dozen cycles of work that doesn't touch shared memory, so the
+// benchmark measures the scheduler and not the job
+static void TinyJob(void *Data)
+{
+    uint32_t X = (uint32_t)(uintptr_t)Data | 1;
+    for (uint32_t Iteration = 0; Iteration < TINY_JOB_ITERATIONS; ++Iteration)
+    {
+        X ^= X << 13;
+        X ^= X >> 17;
+        X ^= X << 5;
+    }
+
+    if (X == 0)
+    {
+        BenchmarkUse(Data);
+    }
+}
+
+// Jobs submitted from inside a job go to the worker's own deque
+static void SpawnerJob(void *Data)
+{
+    const scaling_spawner *Spawner = (const scaling_spawner *)Data;
+    for (uint32_t Job = 0; Job < SCALING_JOBS_PER_SPAWNER; ++Job)
+    {
+        SubmitJob(Spawner->Queue, TinyJob, (void *)(uintptr_t)(Spawner->Seed + Job));
+    }
+}
+
+// 1, 2, 4, ... worker threads and MaxThreads
+static uint32_t GetNextThreadCount(uint32_t NumThreads, uint32_t MaxThreads)
+{
+    if (NumThreads == MaxThreads)
+    {
+        return 0;
+    }
+
+    return NumThreads * 2 < MaxThreads ? NumThreads * 2 : MaxThreads;
+}
+
+//
+// Tiny jobs over an increasing number of worker threads. Spawned jobs are
+// submitted by other jobs and exercise the per worker deques and stealing,
+// submitted jobs all come from the main thread through the shared queue.
+//
+static void RunThreadScalingBenchmarks(const benchmark_context *Context)
+{
+    char Name[64];
+    for (uint32_t NumThreads = 1; NumThreads != 0; NumThreads = GetNextThreadCount(NumThreads, Context->MaxThreads))
+    {
+        std::unique_ptr<parallel_job_queue> Queue(new parallel_job_queue);
+        CreateParallelJobQueue(Queue.get(), NumThreads);
+
+        snprintf(Name, sizeof(Name), "jobs/spawned tiny jobs (%u threads)", NumThreads);
+        if (ShouldRunBenchmark(Context, Name))
+        {
+            scaling_spawner Spawners[SCALING_SPAWNERS];
+            for (uint32_t Index = 0; Index < SCALING_SPAWNERS; ++Index)
+            {
+                Spawners[Index].Queue = Queue.get();
+                Spawners[Index].Seed = Index * SCALING_JOBS_PER_SPAWNER;
+            }
+
+            const uint32_t NumRounds = SCALING_ROUNDS * Context->Repeat;
+            benchmark_timer Timer = BeginBenchmark(Name);
+            for (uint32_t Round = 0; Round < NumRounds; ++Round)
+            {
+                for (scaling_spawner &Spawner : Spawners)
+                {
+                    SubmitJob(Queue.get(), SpawnerJob, &Spawner);
+                }
+
+                WaitForQueueToFinish(Queue.get());
+            }
+
+            EndBenchmark(&Timer, (uint64_t)NumRounds * SCALING_SPAWNERS * (SCALING_JOBS_PER_SPAWNER + 1));
+        }
+
+        snprintf(Name, sizeof(Name), "jobs/submitted tiny jobs (%u threads)", NumThreads);
+        if (ShouldRunBenchmark(Context, Name))
+        {
+            const uint32_t NumRounds = SCALING_ROUNDS * SCALING_SPAWNERS * Context->Repeat;
+            benchmark_timer Timer = BeginBenchmark(Name);
+            for (uint32_t Round = 0; Round < NumRounds; ++Round)
+            {
+                for (uint32_t Job = 0; Job < SCALING_SUBMITTED_JOBS; ++Job)
+                {
+                    SubmitJob(Queue.get(), TinyJob, (void *)(uintptr_t)(Round + Job));
+                }
+
+                WaitForQueueToFinish(Queue.get());
+            }
+
+            EndBenchmark(&Timer, (uint64_t)NumRounds * SCALING_SUBMITTED_JOBS);
+        }
+
+        DestroyParallelJobQueue(Queue.get());
+    }
+}
+
+static void Spin(uint64_t Micros)
+{
+    const uint64_t EndNanos = HiPerformanceTimer::GetTicksNanos() + Micros * 1000;
+    while (HiPerformanceTimer::GetTicksNanos() < EndNanos)
+    {
+    }
+}
+
+struct latency_frame_job
+{
+    uint64_t SubmitNanos;
+    uint64_t LatencyNanos;
+};
+
+// Stands in for streaming work like a texture decode, which splits itself
+// with a ParallelFor that runs at the priority of the job
+static void BackgroundJob(void *Data)
+{
+    ParallelFor((parallel_job_queue *)Data, 0, LATENCY_BACKGROUND_ITEMS, 4, [](uint32_t)
+    {
+        Spin(LATENCY_BACKGROUND_MICROS);
+    });
+}
+
+static void FrameJob(void *Data)
+{
+    latency_frame_job *Job = (latency_frame_job *)Data;
+    Job->LatencyNanos = HiPerformanceTimer::GetTicksNanos() - Job->SubmitNanos;
+    Spin(LATENCY_FRAME_JOB_MICROS);
+}
+
+//
+// Time from submitting a frame critical job until it starts, while the
+// workers are flooded with background jobs. The same background load
+// submitted at normal priority shows what the lanes save, and a run
+// without background load gives the floor.
+//
+static void RunFrameLatencyBenchmark(const benchmark_context *Context, const char *LoadName, bool HasBackgroundLoad, job_priority BackgroundPriority)
+{
+    // At least two workers, with one the background cap can't keep a
+    // worker free for frame jobs
+    const uint32_t NumThreads = Context->MaxThreads > 2 ? Context->MaxThreads : 2;
+    char Name[64];
+    snprintf(Name, sizeof(Name), "jobs/frame latency, %s (%u threads)", LoadName, NumThreads);
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    std::unique_ptr<parallel_job_queue> Queue(new parallel_job_queue);
+    CreateParallelJobQueue(Queue.get(), NumThreads);
+
+    job_counter BackgroundCounter;
+    if (HasBackgroundLoad)
+    {
+        for (uint32_t Job = 0; Job < LATENCY_BACKGROUND_JOBS; ++Job)
+        {
+            SubmitJob(Queue.get(), BackgroundJob, Queue.get(), &BackgroundCounter, BackgroundPriority);
+        }
+    }
+
+    uint64_t TotalNanos = 0;
+    uint64_t WorstNanos = 0;
+    const uint32_t NumFrames = LATENCY_FRAMES * Context->Repeat;
+    std::vector<latency_frame_job> Jobs(LATENCY_JOBS_PER_FRAME);
+    for (uint32_t Frame = 0; Frame < NumFrames; ++Frame)
+    {
+        job_counter FrameCounter;
+        for (latency_frame_job &Job : Jobs)
+        {
+            Job.SubmitNanos = HiPerformanceTimer::GetTicksNanos();
+            SubmitJob(Queue.get(), FrameJob, &Job, &FrameCounter, JobPriority_FrameCritical);
+        }
+
+        WaitForCounter(Queue.get(), &FrameCounter);
+        for (const latency_frame_job &Job : Jobs)
+        {
+            TotalNanos += Job.LatencyNanos;
+            WorstNanos = Job.LatencyNanos > WorstNanos ? Job.LatencyNanos : WorstNanos;
+        }
+
+        // The rest of the frame
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (HasBackgroundLoad)
+    {
+        WaitForCounter(Queue.get(), &BackgroundCounter);
+    }
+
+    WaitForQueueToFinish(Queue.get());
+    DestroyParallelJobQueue(Queue.get());
+
+    const double NumJobs = (double)NumFrames * LATENCY_JOBS_PER_FRAME;
+    PrintBenchmarkResult(Name, "%10.1f us avg %10.1f us worst", (double)TotalNanos / NumJobs / 1000.0, (double)WorstNanos / 1000.0);
+}
+
+void RunJobQueueBenchmarks(const benchmark_context *Context)
+{
+    PrintBenchmarkSection("Job queue thread scaling");
+    RunThreadScalingBenchmarks(Context);
+
+    PrintBenchmarkSection("Frame job latency");
+    RunFrameLatencyBenchmark(Context, "no load", false, JobPriority_Background);
+    RunFrameLatencyBenchmark(Context, "background load", true, JobPriority_Background);
+    RunFrameLatencyBenchmark(Context, "normal load", true, JobPriority_Normal);
+}
\ No newline at end of file
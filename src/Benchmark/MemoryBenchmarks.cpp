@@ -0,0 +1,486 @@
+#include "Precompiled.h"
+#include "Benchmark/Benchmark.h"
+#include "Base/Container/ConcurrentQueue.h"
+#include "Base/Memory.h"
+#include "Base/Sys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define CHURN_BLOCK_SIZE            64
+#define CHURN_LIVE_ALLOCATIONS      1024        // Must be a power of two
+#define CHURN_OPS                   (1 << 21)
+#define MIXED_LIVE_ALLOCATIONS      4096        // Must be a power of two
+#define MIXED_OPS                   (1 << 20)
+#define MIXED_POOL_SIZE             Megabytes(64)
+#define HANDOFF_OPS_PER_PAIR        (1 << 19)
+#define HANDOFF_RING_SIZE           1024
+#define TLSF_HEAP_SIZE              Megabytes(64)
+#define CLEAR_POOL_SIZE             Megabytes(64)
+#define CLEAR_BYTES_PER_SIZE        Megabytes(512)
+#define CLEAR_WALK_SIZE             Megabytes(256)      // Larger than the last level cache
+
+struct churn_block
+{
+    uint8_t Bytes[CHURN_BLOCK_SIZE];
+};
+
+// xorshift32, the same sequence on every run
+static uint32_t NextRandom(uint32_t *State)
+{
+    uint32_t X = *State;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *State = X;
+    return X;
+}
+
+// 16 bytes to 4kb, smaller sizes more likely, like the allocations of a
+// typical frame
+static void FillMixedSizes(uint32_t *Sizes, uint32_t NumSizes)
+{
+    uint32_t RandomState = 0x9e3779b9;
+    for (uint32_t Index = 0; Index < NumSizes; ++Index)
+    {
+        const uint32_t Shift = NextRandom(&RandomState) % 9;
+        const uint32_t Base = 16u << (NextRandom(&RandomState) % (Shift + 1));
+        Sizes[Index] = Base + (NextRandom(&RandomState) & (Base - 1));
+    }
+}
+
+//
+// Allocate and free one size with a fixed number of live allocations,
+// the oldest allocation is freed before each new one.
+//
+template <class AllocFunc, class FreeFunc>
+static void RunChurnBenchmark(const benchmark_context *Context, const char *Name, AllocFunc Alloc, FreeFunc Free)
+{
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    std::vector<void *> Live(CHURN_LIVE_ALLOCATIONS, nullptr);
+    const uint64_t NumOps = (uint64_t)CHURN_OPS * Context->Repeat;
+    benchmark_timer Timer = BeginBenchmark(Name);
+    for (uint64_t Op = 0; Op < NumOps; ++Op)
+    {
+        void *&Slot = Live[Op & (CHURN_LIVE_ALLOCATIONS - 1)];
+        if (Slot)
+        {
+            Free(Slot);
+        }
+
+        Slot = Alloc(CHURN_BLOCK_SIZE);
+        *(uint8_t *)Slot = (uint8_t)Op;
+        BenchmarkUse(Slot);
+    }
+
+    EndBenchmark(&Timer, NumOps);
+    for (void *Pointer : Live)
+    {
+        if (Pointer)
+        {
+            Free(Pointer);
+        }
+    }
+}
+
+// Pools don't free single allocations, the pool is reset once for every
+// CHURN_LIVE_ALLOCATIONS pushes instead
+static void RunPoolChurnBenchmark(const benchmark_context *Context, const char *Name, uint32_t Flags)
+{
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    const memory_index PoolSize = CHURN_LIVE_ALLOCATIONS * (CHURN_BLOCK_SIZE + 16);
+    std::unique_ptr<uint8_t[]> PoolMemory(new uint8_t[PoolSize]);
+    memory_pool Pool = {};
+    InitializeMemoryPool(&Pool, PoolSize, PoolMemory.get());
+
+    const uint64_t NumOps = (uint64_t)CHURN_OPS * Context->Repeat;
+    benchmark_timer Timer = BeginBenchmark(Name);
+    for (uint64_t Op = 0; Op < NumOps; ++Op)
+    {
+        if ((Op & (CHURN_LIVE_ALLOCATIONS - 1)) == 0)
+        {
+            Pool.Used = 0;
+        }
+
+        void *Block = PushSize(&Pool, CHURN_BLOCK_SIZE, Flags);
+        *(uint8_t *)Block = (uint8_t)Op;
+        BenchmarkUse(Block);
+    }
+
+    EndBenchmark(&Timer, NumOps);
+}
+
+//
+// Allocate random sizes and free a random live allocation before each new
+// one, so the free lists of the heaps get fragmented.
+//
+template <class AllocFunc, class FreeFunc>
+static void RunMixedBenchmark(const benchmark_context *Context, const char *Name, const uint32_t *Sizes, AllocFunc Alloc, FreeFunc Free)
+{
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    std::vector<void *> Live(MIXED_LIVE_ALLOCATIONS, nullptr);
+    uint32_t RandomState = 0x2545f491;
+    const uint64_t NumOps = (uint64_t)MIXED_OPS * Context->Repeat;
+    benchmark_timer Timer = BeginBenchmark(Name);
+    for (uint64_t Op = 0; Op < NumOps; ++Op)
+    {
+        void *&Slot = Live[NextRandom(&RandomState) & (MIXED_LIVE_ALLOCATIONS - 1)];
+        if (Slot)
+        {
+            Free(Slot);
+        }
+
+        Slot = Alloc(Sizes[Op & (MIXED_OPS - 1)]);
+        *(uint8_t *)Slot = (uint8_t)Op;
+        BenchmarkUse(Slot);
+    }
+
+    EndBenchmark(&Timer, NumOps);
+    for (void *Pointer : Live)
+    {
+        if (Pointer)
+        {
+            Free(Pointer);
+        }
+    }
+}
+
+// The pool is reset when it's full, like frame memory
+static void RunPoolMixedBenchmark(const benchmark_context *Context, const char *Name, const uint32_t *Sizes, uint32_t Flags)
+{
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    std::unique_ptr<uint8_t[]> PoolMemory(new uint8_t[MIXED_POOL_SIZE]);
+    memory_pool Pool = {};
+    InitializeMemoryPool(&Pool, MIXED_POOL_SIZE, PoolMemory.get());
+
+    const uint64_t NumOps = (uint64_t)MIXED_OPS * Context->Repeat;
+    benchmark_timer Timer = BeginBenchmark(Name);
+    for (uint64_t Op = 0; Op < NumOps; ++Op)
+    {
+        const uint32_t Size = Sizes[Op & (MIXED_OPS - 1)];
+        if (!CanPushSize(&Pool, Size, Flags))
+        {
+            Pool.Used = 0;
+        }
+
+        void *Block = PushSize(&Pool, Size, Flags);
+        *(uint8_t *)Block = (uint8_t)Op;
+        BenchmarkUse(Block);
+    }
+
+    EndBenchmark(&Timer, NumOps);
+}
+
+//
+// Producer threads allocate and hand the allocations to a consumer thread
+// that frees them, so every free happens on another thread than the
+// allocation. One producer/consumer pair per two threads.
+//
+struct handoff_pair
+{
+    SPSCRing<void *, HANDOFF_RING_SIZE> Ring;
+};
+
+template <class AllocFunc, class FreeFunc>
+static void RunHandoffBenchmark(const benchmark_context *Context, const char *Name, AllocFunc Alloc, FreeFunc Free)
+{
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    const uint32_t NumPairs = Context->MaxThreads >= 4 ? Context->MaxThreads / 2 : 1;
+    const uint64_t OpsPerPair = (uint64_t)HANDOFF_OPS_PER_PAIR * Context->Repeat;
+    std::unique_ptr<handoff_pair[]> Pairs(new handoff_pair[NumPairs]);
+    std::vector<std::thread> Threads;
+
+    char TimerName[64];
+    snprintf(TimerName, sizeof(TimerName), "%s (%u producers)", Name, NumPairs);
+    benchmark_timer Timer = BeginBenchmark(TimerName);
+    for (uint32_t PairIndex = 0; PairIndex < NumPairs; ++PairIndex)
+    {
+        handoff_pair *Pair = &Pairs[PairIndex];
+        Threads.emplace_back([Pair, OpsPerPair, &Alloc]()
+        {
+            for (uint64_t Op = 0; Op < OpsPerPair; ++Op)
+            {
+                void *Block = Alloc(CHURN_BLOCK_SIZE);
+                *(uint8_t *)Block = (uint8_t)Op;
+                while (!Pair->Ring.TryPush(Block))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        Threads.emplace_back([Pair, OpsPerPair, &Free]()
+        {
+            for (uint64_t Op = 0; Op < OpsPerPair; ++Op)
+            {
+                void *Block;
+                while (!Pair->Ring.TryPop(&Block))
+                {
+                    std::this_thread::yield();
+                }
+
+                Free(Block);
+            }
+        });
+    }
+
+    for (std::thread &Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    EndBenchmark(&Timer, NumPairs * OpsPerPair);
+}
+
+//
+// Clear large blocks. A dirty pool has to clear every push, a pool over
+// freshly reserved memory knows its memory is zero and skips the clear.
+// The dirty pool walks through all of its memory like frame memory does,
+// while malloc usually hands back the same block that is still cached.
+//
+static void RunClearBenchmarks(const benchmark_context *Context, memory_index BlockSize, const char *SizeName)
+{
+    const uint64_t NumOps = (CLEAR_BYTES_PER_SIZE / BlockSize) * Context->Repeat;
+    char Name[64];
+
+    snprintf(Name, sizeof(Name), "clear %s/PushSize dirty pool", SizeName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        std::unique_ptr<uint8_t[]> PoolMemory(new uint8_t[CLEAR_POOL_SIZE]);
+        memset(PoolMemory.get(), 0xcd, CLEAR_POOL_SIZE);
+        memory_pool Pool = {};
+        InitializeMemoryPool(&Pool, CLEAR_POOL_SIZE, PoolMemory.get());
+
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            if (!CanPushSize(&Pool, BlockSize, MemoryAllocation_Align16))
+            {
+                Pool.Used = 0;
+            }
+
+            BenchmarkUse(PushSize(&Pool, BlockSize, MemoryAllocation_Align16 | MemoryAllocation_Clear));
+        }
+
+        EndBenchmark(&Timer, NumOps);
+    }
+
+    snprintf(Name, sizeof(Name), "clear %s/PushSize fresh pool", SizeName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        // A new reservation for every pool full, includes the commit cost
+        const uint64_t BlocksPerPool = CLEAR_POOL_SIZE / BlockSize - 1;
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; Op += BlocksPerPool)
+        {
+            void *Base = Sys_Reserve(CLEAR_POOL_SIZE);
+            memory_pool Pool = {};
+            InitializeReservedMemoryPool(&Pool, CLEAR_POOL_SIZE, Base, Megabytes(2));
+            for (uint64_t Block = 0; Block < BlocksPerPool; ++Block)
+            {
+                BenchmarkUse(PushSize(&Pool, BlockSize, MemoryAllocation_Align16 | MemoryAllocation_Clear));
+            }
+
+            Sys_Free(Base);
+        }
+
+        EndBenchmark(&Timer, (NumOps + BlocksPerPool - 1) / BlocksPerPool * BlocksPerPool);
+    }
+
+    snprintf(Name, sizeof(Name), "clear %s/malloc+memset", SizeName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            void *Block = malloc(BlockSize);
+            memset(Block, 0, BlockSize);
+            BenchmarkUse(Block);
+            free(Block);
+        }
+
+        EndBenchmark(&Timer, NumOps);
+    }
+
+    snprintf(Name, sizeof(Name), "clear %s/calloc", SizeName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            void *Block = calloc(1, BlockSize);
+            BenchmarkUse(Block);
+            free(Block);
+        }
+
+        EndBenchmark(&Timer, NumOps);
+    }
+}
+
+// Touch one byte per cache line, like code filling the cleared block would
+static uint64_t ReadCacheLines(const uint8_t *Block, memory_index Size)
+{
+    uint64_t Sum = 0;
+    for (memory_index Offset = 0; Offset < Size; Offset += 64)
+    {
+        Sum += Block[Offset];
+    }
+
+    return Sum;
+}
+
+//
+// memset against ClearMemoryNonTemporal for the same blocks, to pick
+// CLEAR_MEMORY_NON_TEMPORAL_SIZE. Cold blocks walk through memory larger
+// than the cache like a dirty pool being reused, with "+read" the block is
+// read back right after the clear. Hot blocks clear the same memory again
+// and again.
+//
+template <class ClearFunc>
+static void RunClearStrategyBenchmark(const benchmark_context *Context, memory_index BlockSize, const char *SizeName,
+                                      const char *StrategyName, uint8_t *WalkMemory, ClearFunc Clear)
+{
+    const uint64_t NumOps = (CLEAR_BYTES_PER_SIZE / BlockSize) * Context->Repeat;
+    const uint64_t BlocksPerWalk = CLEAR_WALK_SIZE / BlockSize;
+    char Name[64];
+
+    snprintf(Name, sizeof(Name), "clear strategy %s/%s cold", SizeName, StrategyName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            Clear(WalkMemory + (Op % BlocksPerWalk) * BlockSize, BlockSize);
+        }
+
+        EndBenchmark(&Timer, NumOps);
+    }
+
+    snprintf(Name, sizeof(Name), "clear strategy %s/%s cold+read", SizeName, StrategyName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        uint64_t Sum = 0;
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            uint8_t *Block = WalkMemory + (Op % BlocksPerWalk) * BlockSize;
+            Clear(Block, BlockSize);
+            Sum += ReadCacheLines(Block, BlockSize);
+        }
+
+        EndBenchmark(&Timer, NumOps);
+        BenchmarkUse((const void *)(uintptr_t)Sum);
+    }
+
+    snprintf(Name, sizeof(Name), "clear strategy %s/%s hot", SizeName, StrategyName);
+    if (ShouldRunBenchmark(Context, Name))
+    {
+        benchmark_timer Timer = BeginBenchmark(Name);
+        for (uint64_t Op = 0; Op < NumOps; ++Op)
+        {
+            Clear(WalkMemory, BlockSize);
+            BenchmarkUse(WalkMemory);
+        }
+
+        EndBenchmark(&Timer, NumOps);
+    }
+}
+
+static void RunClearStrategyBenchmarks(const benchmark_context *Context)
+{
+    // Committed and dirty before the timing starts
+    uint8_t *WalkMemory = (uint8_t *)Sys_Alloc(CLEAR_WALK_SIZE);
+    memset(WalkMemory, 0xcd, CLEAR_WALK_SIZE);
+
+    auto Memset = [](void *Address, memory_index Length) { memset(Address, 0, Length); };
+    auto NonTemporal = [](void *Address, memory_index Length) { ClearMemoryNonTemporal(Address, Length); };
+    static const memory_index BlockSizes[] = { Kilobytes(16), Kilobytes(64), Kilobytes(256), Megabytes(1), Megabytes(4), Megabytes(8), Megabytes(16) };
+    static const char *SizeNames[] = { "16kb", "64kb", "256kb", "1mb", "4mb", "8mb", "16mb" };
+    for (uint32_t SizeIndex = 0; SizeIndex < sizeof(BlockSizes) / sizeof(BlockSizes[0]); ++SizeIndex)
+    {
+        RunClearStrategyBenchmark(Context, BlockSizes[SizeIndex], SizeNames[SizeIndex], "memset", WalkMemory, Memset);
+        RunClearStrategyBenchmark(Context, BlockSizes[SizeIndex], SizeNames[SizeIndex], "non-temporal", WalkMemory, NonTemporal);
+    }
+
+    Sys_Free(WalkMemory);
+}
+
+void RunMemoryBenchmarks(const benchmark_context *Context)
+{
+    auto Malloc = [](size_t Size) { return malloc(Size); };
+    auto Free = [](void *Pointer) { free(Pointer); };
+    auto New = [](size_t Size) { return (void *)new uint8_t[Size]; };
+    auto Delete = [](void *Pointer) { delete[] (uint8_t *)Pointer; };
+
+    BlockPool<churn_block> SharedPool;
+    auto SharedPoolAlloc = [&SharedPool](size_t) { return SharedPool.Allocate(); };
+    auto SharedPoolFree = [&SharedPool](void *Pointer) { SharedPool.Free(Pointer); };
+    BlockPool<churn_block, 64, true> CachedPool;
+    auto CachedPoolAlloc = [&CachedPool](size_t) { return CachedPool.Allocate(); };
+    auto CachedPoolFree = [&CachedPool](void *Pointer) { CachedPool.Free(Pointer); };
+
+    void *TlsfMemory = Sys_Alloc(TLSF_HEAP_SIZE);
+    tlsf_heap Heap;
+    InitializeTlsfHeap(&Heap, TlsfMemory, TLSF_HEAP_SIZE);
+    auto TlsfAllocFunc = [&Heap](size_t Size) { return TlsfAlloc(&Heap, Size); };
+    auto TlsfFreeFunc = [&Heap](void *Pointer) { TlsfFree(&Heap, Pointer); };
+
+    PrintBenchmarkSection("Same size churn, 64 bytes");
+    RunChurnBenchmark(Context, "churn/malloc", Malloc, Free);
+    RunChurnBenchmark(Context, "churn/new", New, Delete);
+    RunChurnBenchmark(Context, "churn/BlockPool", SharedPoolAlloc, SharedPoolFree);
+    RunChurnBenchmark(Context, "churn/BlockPool thread cache", CachedPoolAlloc, CachedPoolFree);
+    RunChurnBenchmark(Context, "churn/TLSF", TlsfAllocFunc, TlsfFreeFunc);
+    RunPoolChurnBenchmark(Context, "churn/PushSize", MemoryAllocation_Default);
+    RunPoolChurnBenchmark(Context, "churn/PushSize clear", MemoryAllocation_Default | MemoryAllocation_Clear);
+
+    PrintBenchmarkSection("Mixed sizes, 16 bytes to 4kb");
+    std::vector<uint32_t> Sizes(MIXED_OPS);
+    FillMixedSizes(Sizes.data(), MIXED_OPS);
+    RunMixedBenchmark(Context, "mixed/malloc", Sizes.data(), Malloc, Free);
+    RunMixedBenchmark(Context, "mixed/new", Sizes.data(), New, Delete);
+    RunMixedBenchmark(Context, "mixed/TLSF", Sizes.data(), TlsfAllocFunc, TlsfFreeFunc);
+    RunPoolMixedBenchmark(Context, "mixed/PushSize", Sizes.data(), MemoryAllocation_Default);
+    RunPoolMixedBenchmark(Context, "mixed/PushSize clear", Sizes.data(), MemoryAllocation_Default | MemoryAllocation_Clear);
+
+    // The TLSF heap isn't thread safe and pools are per thread, only the
+    // allocators that can free on another thread are measured
+    PrintBenchmarkSection("Producer/consumer frees, 64 bytes");
+    RunHandoffBenchmark(Context, "handoff/malloc", Malloc, Free);
+    RunHandoffBenchmark(Context, "handoff/new", New, Delete);
+    RunHandoffBenchmark(Context, "handoff/BlockPool", SharedPoolAlloc, SharedPoolFree);
+    RunHandoffBenchmark(Context, "handoff/BlockPool thread cache", CachedPoolAlloc, CachedPoolFree);
+
+    PrintBenchmarkSection("Large block clears");
+    RunClearBenchmarks(Context, Kilobytes(64), "64kb");
+    RunClearBenchmarks(Context, Megabytes(1), "1mb");
+    RunClearBenchmarks(Context, Megabytes(16), "16mb");
+
+    PrintBenchmarkSection("Clear strategy");
+    RunClearStrategyBenchmarks(Context);
+
+    Sys_Free(TlsfMemory);
+}
\ No newline at end of file
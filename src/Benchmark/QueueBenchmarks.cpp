@@ -0,0 +1,124 @@
+#include "Precompiled.h"
+#include "Benchmark/Benchmark.h"
+#include "Base/Container/ConcurrentQueue.h"
+#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define QUEUE_CAPACITY              1024
+#define QUEUE_OPS_PER_PRODUCER      (1 << 20)
+
+// The queue a std::deque and a lock gives, to compare the lock free
+// queues against
+template <class T, uint32_t Capacity>
+class LockedQueue
+{
+public:
+    template <class U>
+    bool TryPush(U &&value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (values.size() == Capacity)
+        {
+            return false;
+        }
+
+        values.push_back(std::forward<U>(value));
+        return true;
+    }
+
+    bool TryPop(T *outValue)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (values.empty())
+        {
+            return false;
+        }
+
+        *outValue = std::move(values.front());
+        values.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex lock;
+    std::deque<T> values;
+};
+
+//
+// Every producer pushes the same number of values and every consumer pops
+// that many, the threads yield while the queue is full or empty. Reports
+// the time per value through the queue.
+//
+template <class Queue>
+static void RunQueueBenchmark(const benchmark_context *Context, const char *QueueName, uint32_t NumPairs)
+{
+    char Name[64];
+    snprintf(Name, sizeof(Name), "queue/%s (%u producers, %u consumers)", QueueName, NumPairs, NumPairs);
+    if (!ShouldRunBenchmark(Context, Name))
+    {
+        return;
+    }
+
+    std::unique_ptr<Queue> Values(new Queue);
+    const uint64_t OpsPerThread = (uint64_t)QUEUE_OPS_PER_PRODUCER * Context->Repeat;
+    std::vector<std::thread> Threads;
+
+    benchmark_timer Timer = BeginBenchmark(Name);
+    for (uint32_t Pair = 0; Pair < NumPairs; ++Pair)
+    {
+        Queue *QueuePointer = Values.get();
+        Threads.emplace_back([QueuePointer, OpsPerThread]()
+        {
+            for (uint64_t Op = 0; Op < OpsPerThread; ++Op)
+            {
+                while (!QueuePointer->TryPush(Op))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        Threads.emplace_back([QueuePointer, OpsPerThread]()
+        {
+            uint64_t Sum = 0;
+            for (uint64_t Op = 0; Op < OpsPerThread; ++Op)
+            {
+                uint64_t Value;
+                while (!QueuePointer->TryPop(&Value))
+                {
+                    std::this_thread::yield();
+                }
+
+                Sum += Value;
+            }
+
+            BenchmarkUse((const void *)(uintptr_t)Sum);
+        });
+    }
+
+    for (std::thread &Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    EndBenchmark(&Timer, NumPairs * OpsPerThread);
+}
+
+void RunQueueBenchmarks(const benchmark_context *Context)
+{
+    const uint32_t NumPairs = Context->MaxThreads >= 4 ? Context->MaxThreads / 2 : 1;
+
+    PrintBenchmarkSection("Concurrent queues, 64 bit values");
+    RunQueueBenchmark<SPSCRing<uint64_t, QUEUE_CAPACITY>>(Context, "SPSCRing", 1);
+    RunQueueBenchmark<MPMCQueue<uint64_t, QUEUE_CAPACITY>>(Context, "MPMCQueue", 1);
+    RunQueueBenchmark<LockedQueue<uint64_t, QUEUE_CAPACITY>>(Context, "mutex deque", 1);
+    if (NumPairs > 1)
+    {
+        RunQueueBenchmark<MPMCQueue<uint64_t, QUEUE_CAPACITY>>(Context, "MPMCQueue", NumPairs);
+        RunQueueBenchmark<LockedQueue<uint64_t, QUEUE_CAPACITY>>(Context, "mutex deque", NumPairs);
+    }
+}
\ No newline at end of file
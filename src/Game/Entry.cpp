@@ -6,25 +6,61 @@
 #include "Renderer/CommandBuffer.h"
 #include "Renderer/Backend.h"
 
+#define GAME_MEMORY_HUGE_PAGE_THRESHOLD     Megabytes(32)
+#define GAME_TRANSIENT_COMMIT_SIZE          Megabytes(2)
+
+bool AllocateGameMemory(game_memory *Memory, uint64_t PermanentStorageSize, uint64_t TransientStorageSize)
+{
+    *Memory = {};
+    Memory->PermanentStorageSize = PermanentStorageSize;
+    Memory->TransientStorageSize = TransientStorageSize;
+
+    // Only permanent storage is committed up front, transient storage is
+    // committed by the pools using it
+    uint64_t GameMemoryBlockSize = Memory->PermanentStorageSize +
+                                   Memory->TransientStorageSize;
+    const uint32_t ReserveFlags = GameMemoryBlockSize >= GAME_MEMORY_HUGE_PAGE_THRESHOLD ? SYS_RESERVE_HUGE_PAGES : 0;
+    void *GameMemoryBlock = Sys_Reserve(GameMemoryBlockSize, ReserveFlags);
+    if (!GameMemoryBlock || !Sys_Commit(GameMemoryBlock, Memory->PermanentStorageSize))
+    {
+        Sys_Free(GameMemoryBlock);
+        return false;
+    }
+
+    Memory->PermanentStorage = GameMemoryBlock;
+    Memory->TransientStorage = ((uint8_t *)Memory->PermanentStorage + Memory->PermanentStorageSize);
+    return true;
+}
+
+void FreeGameMemory(game_memory *Memory)
+{
+    // Permanent storage is the start of the block
+    Sys_Free(Memory->PermanentStorage);
+    *Memory = {};
+}
+
 int GameEntryFunction(const game_entry_params *Params)
 {
-    game_memory GameMemory = {};
-    GameMemory.PermanentStorageSize = Params->PermanentStorageSize;
-    GameMemory.TransientStorageSize = Params->TransientStorageSize;
+    game_memory GameMemory;
+    if (!AllocateGameMemory(&GameMemory, Params->PermanentStorageSize, Params->TransientStorageSize))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Per frame data lives in two arenas at the start of transient storage
+    memory_pool TransientPool;
+    InitializeReservedMemoryPool(&TransientPool, GameMemory.TransientStorageSize, GameMemory.TransientStorage, GAME_TRANSIENT_COMMIT_SIZE);
 
-    uint64_t GameMemoryBlockSize = GameMemory.PermanentStorageSize +
-                                   GameMemory.TransientStorageSize;
-    void *GameMemoryBlock = Sys_Alloc(GameMemoryBlockSize);
-    
-    GameMemory.PermanentStorage = GameMemoryBlock;
-    GameMemory.TransientStorage = ((uint8_t *)GameMemory.PermanentStorage + GameMemory.PermanentStorageSize);
+    frame_memory FrameMemory;
+    InitializeFrameMemory(&FrameMemory, &TransientPool, TransientPool.Size / 4);
 
-    uint32_t RenderCommandStorageSize = Params->RenderCommandStorageSize;
-    void *RenderCommandStorage = Sys_Alloc(RenderCommandStorageSize);
+    memory_pool *FrameArena = BeginFrameMemory(&FrameMemory);
 
     // Render
     if (Params->RenderCallback)
     {
+        uint32_t RenderCommandStorageSize = Params->RenderCommandStorageSize;
+        void *RenderCommandStorage = PushSize(FrameArena, RenderCommandStorageSize, MemoryAllocation_Align16);
         render_command_buffer RenderCommands = RenderCommandBufferStruct(RenderCommandStorageSize, RenderCommandStorage);
         Params->RenderCallback(&RenderCommands);
 
@@ -32,7 +68,6 @@ int GameEntryFunction(const game_entry_params *Params)
         Sys_Sleep(1);
     }
 
-    Sys_Free(RenderCommandStorage);
-    Sys_Free(GameMemoryBlock);
+    FreeGameMemory(&GameMemory);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -22,4 +22,9 @@ struct game_entry_params
     void(*RenderCallback)(render_command_buffer *RenderCommands);
 };
 
+// Allocate permanent and transient storage as one block. Transient storage
+// is only reserved, use it through a pool made with InitializeReservedMemoryPool.
+bool AllocateGameMemory(game_memory *Memory, uint64_t PermanentStorageSize, uint64_t TransientStorageSize);
+void FreeGameMemory(game_memory *Memory);
+
 int GameEntryFunction(const game_entry_params *Params);
\ No newline at end of file
@@ -4,10 +4,35 @@
 #include "Base/File.h"
 #include "Base/Timer.h"
 #include "Base/Sys.h"
+#include "Base/ParallelJobQueue.h"
 #include "Renderer/stb_image.h"
 #include "Renderer/Texture.h"
+#include "Renderer/Backend.h"
 #include <GLFW/glfw3.h>
 
+// Give SMT siblings a worker each, they share execution units with an
+// already busy core so this only pays off for latency bound jobs
+#define JOB_QUEUE_USE_SMT_SIBLINGS  0
+
+// Record a timeline of timed blocks and jobs, saved to DEBUG_TRACE_FILENAME
+// on exit. Open it in chrome://tracing.
+#define ENABLE_DEBUG_TRACE          0
+#define DEBUG_TRACE_FILENAME        "trace.json"
+
+#define GAME_PERMANENT_STORAGE_SIZE Megabytes(64)
+#define GAME_TRANSIENT_STORAGE_SIZE Megabytes(512)
+#define GAME_TRANSIENT_COMMIT_SIZE  Megabytes(2)          // One huge page
+#define SCRATCH_MEMORY_PER_THREAD   Megabytes(16)
+#define FRAME_MEMORY_SIZE           Megabytes(64)
+#define RENDER_COMMAND_BUFFER_SIZE  Megabytes(4)
+
+// Assert when a frame makes more than MAX_FRAME_ALLOCATIONS heap
+// allocations once the first frames are done, all per frame data should
+// come from the frame memory
+#define ASSERT_FRAME_ALLOCATIONS    0
+#define MAX_FRAME_ALLOCATIONS       0
+#define NUM_WARMUP_FRAMES           4
+
 static void KeyCallback(GLFWwindow *window, int key, int /*scancode*/, int action, int /*mods*/)
 {
     GLFWCallbackPointerData *data = (GLFWCallbackPointerData*)glfwGetWindowUserPointer(window);
@@ -108,8 +133,11 @@ bool GameAppBase::SetupWindow(uint32_t width, uint32_t height, const char *title
     glfwSetMouseButtonCallback(window, MouseButtonCallback);
 
     // initialize the renderer
-    renderDevice = renderer::CreateRenderDevice();
-    RETURN_FALSE_IF(!renderDevice->Init());
+    {
+        MEMORY_TAG_SCOPE(MemoryTag_Renderer);
+        renderDevice = renderer::CreateRenderDevice();
+        RETURN_FALSE_IF(!renderDevice->Init());
+    }
 
     // load custom cursor (if avialable)
     SetMouseCursor("assets/cursor.png", 0, 0);
@@ -131,10 +159,9 @@ bool GameAppBase::SetMouseCursor(const char *filename, int xHot, int yHot)
         int bpp;
         GLFWimage image;
 
-        const stbi_uc *rawTextureBuffer = new stbi_uc[textureFile.GetLength()];
-        textureFile.Read((uint8_t *)rawTextureBuffer, textureFile.GetLength());
-        image.pixels = stbi_load_from_memory(rawTextureBuffer, (int)textureFile.GetLength(), &image.width, &image.height, &bpp, 4);
-        delete[] rawTextureBuffer;
+        scoped_scratch_buffer rawTextureBuffer(textureFile.GetLength());
+        textureFile.Read(rawTextureBuffer.Data, textureFile.GetLength());
+        image.pixels = stbi_load_from_memory(rawTextureBuffer.Data, (int)textureFile.GetLength(), &image.width, &image.height, &bpp, 4);
 
         GLFWcursor *cursor = glfwCreateCursor(&image, xHot, yHot);
         glfwSetCursor((GLFWwindow*)glfwWindow, cursor);
@@ -153,6 +180,10 @@ void GameAppBase::MainLoop()
     {
         const double timerStart = HiPerformanceTimer::GetSeconds();
 
+        memory_pool *frameArena = BeginFrameMemory(&frameMemory);
+        void *renderCommandStorage = PushSize(frameArena, RENDER_COMMAND_BUFFER_SIZE, MemoryAllocation_Align16);
+        renderCommands = RenderCommandBufferStruct((uint32_t)RENDER_COMMAND_BUFFER_SIZE, renderCommandStorage);
+
         {
             TIMED_NAMED_BLOCK("UpdateGameLogic");
             UpdateGameLogic();
@@ -161,12 +192,14 @@ void GameAppBase::MainLoop()
         {
             TIMED_NAMED_BLOCK("RenderFrame");
             Render();
+            ExecuteCommandBuffer(&renderCommands);
             glfwSwapBuffers(window);
+            renderDevice->GetResources()->CollectGarbage();
         }
 
         // process key bindings
         glfwPollEvents();
-        for (auto keyBinding : callbackData.keyBinds)
+        for (const auto &keyBinding : callbackData.keyBinds)
         {
             if (callbackData.keyState[keyBinding.first])
             {
@@ -176,6 +209,12 @@ void GameAppBase::MainLoop()
 
         frameTimer = HiPerformanceTimer::GetSeconds() - timerStart;
         timer += frameTimer;
+
+        const uint32_t frameAllocations = GetAndResetFrameAllocationCount();
+        if (ASSERT_FRAME_ALLOCATIONS && frameMemory.FrameIndex > NUM_WARMUP_FRAMES)
+        {
+            assert(frameAllocations <= MAX_FRAME_ALLOCATIONS && "Too many heap allocations in a frame");
+        }
     }
 }
 
@@ -189,6 +228,52 @@ void GameAppBase::BindMouseMove(std::function<void(const MouseStateInfo &)> call
     callbackData.mouseMoveCallback = callback;
 }
 
+static void CreateGlobalJobQueue(const Sys_ProcessorTopology &topology)
+{
+    // The main thread is pinned to the first core, every other core gets a
+    // worker pinned to it so threads don't migrate between cores. SMT
+    // siblings of the first core are left to the main thread
+    const uint32_t numProcessors = JOB_QUEUE_USE_SMT_SIBLINGS ? topology.numLogicalProcessors : topology.numCores;
+    uint32_t workerProcessors[SYS_MAX_LOGICAL_PROCESSORS];
+    uint32_t numWorkers = 0;
+    for (uint32_t i = 1; i < numProcessors; ++i)
+    {
+        if (topology.coreIndices[i] != topology.coreIndices[0])
+        {
+            workerProcessors[numWorkers++] = topology.logicalProcessors[i];
+        }
+    }
+
+    if (numWorkers == 0)
+    {
+        CreateParallelJobQueue(GlobalJobQueue, 1);
+        return;
+    }
+
+    Sys_SetCurrentThreadAffinity(topology.logicalProcessors[0]);
+    CreateParallelJobQueue(GlobalJobQueue, numWorkers, workerProcessors);
+}
+
+static bool InitializeGameMemory(game_memory *memory, tlsf_heap *permanentHeap, memory_pool *transientPool, frame_memory *frameMemory)
+{
+    RETURN_FALSE_IF(!AllocateGameMemory(memory, GAME_PERMANENT_STORAGE_SIZE, GAME_TRANSIENT_STORAGE_SIZE));
+    InitializeTlsfHeap(permanentHeap, memory->PermanentStorage, memory->PermanentStorageSize);
+    InitializeReservedMemoryPool(transientPool, memory->TransientStorageSize, memory->TransientStorage, GAME_TRANSIENT_COMMIT_SIZE);
+    InitializeFrameMemory(frameMemory, transientPool, FRAME_MEMORY_SIZE);
+
+    // One scratch pool for each job queue thread including the main thread,
+    // using at most half of what's left of the transient storage
+    uint32_t numScratchThreads = GlobalJobQueue->NumWorkerSlots;
+    memory_index scratchMemorySize = numScratchThreads * SCRATCH_MEMORY_PER_THREAD;
+    if (scratchMemorySize > (transientPool->Size - transientPool->Used) / 2)
+    {
+        scratchMemorySize = (transientPool->Size - transientPool->Used) / 2;
+    }
+
+    InitializeScratchMemory(transientPool, scratchMemorySize, numScratchThreads);
+    return true;
+}
+
 static bool InitializeApplication(GameAppBase *application, uint32_t width, uint32_t height, const char *title)
 {
     TIMED_NAMED_BLOCK("Initialization");
@@ -201,6 +286,9 @@ static bool InitializeApplication(GameAppBase *application, uint32_t width, uint
 
 int RunGameApplication(GameAppBase *application, uint32_t width, uint32_t height, const char *title)
 {
+    DebugTraceSetThreadName("Main thread");
+    DebugEnableTrace(ENABLE_DEBUG_TRACE != 0);
+
     Sys_ProcessorInfo cpuInfo;
     Sys_GetProcessorInfo(&cpuInfo);
 
@@ -217,22 +305,41 @@ int RunGameApplication(GameAppBase *application, uint32_t width, uint32_t height
         gpuNum++;
     }
 
+    Sys_ProcessorTopology cpuTopology;
+    Sys_GetProcessorTopology(&cpuTopology);
+    CreateGlobalJobQueue(cpuTopology);
+    DebugPrintf("Job queue: %d workers on %d physical cores\n", GlobalJobQueue->NumWorkers, cpuTopology.numCores);
+
     int returnValue = EXIT_FAILURE;
-    if (InitializeApplication(application, width, height, title))
+    if (InitializeGameMemory(&application->gameMemory, &application->permanentHeap, &application->transientPool, &application->frameMemory) &&
+        InitializeApplication(application, width, height, title))
     {
         application->MainLoop();
         returnValue = EXIT_SUCCESS;
+
+        DebugPrintf("Frame memory: %llu of %llu bytes used at peak\n",
+                    (unsigned long long)application->frameMemory.PeakUsed,
+                    (unsigned long long)FRAME_MEMORY_SIZE);
+        DebugLogTlsfHeap(&application->permanentHeap, "Permanent storage");
     } 
 
     renderer::globalTextureCache->Destroy();
     application->Shutdown();
+    DestroyParallelJobQueue(GlobalJobQueue);
+    DestroyScratchMemory();
+    FreeGameMemory(&application->gameMemory);
     delete application;
     glfwTerminate();
     if (returnValue != EXIT_FAILURE)
     {
         DebugLogPerformanceCounters(DebugPerformenceRecord::staticRecords);
+        DebugLogMemoryCounters();
     }
 
     SaveDebugLogToFile("debuglog.txt");
+    if (ENABLE_DEBUG_TRACE)
+    {
+        SaveDebugTraceToFile(DEBUG_TRACE_FILENAME);
+    }
     return returnValue;
 }
\ No newline at end of file
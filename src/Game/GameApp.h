@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Renderer/RenderDevice.h"
+#include "Renderer/CommandBuffer.h"
+#include "Base/Memory.h"
+#include "Game/Entry.h"
 
 struct MouseStateInfo
 {
@@ -36,6 +39,14 @@ public:
 
     std::shared_ptr<renderer::IRenderDevice> GetRenderDevice() { return renderDevice; }
 
+    // Released two frames later, use it for anything that only lives for
+    // the current frame.
+    memory_pool *GetFrameMemory() { return GetFrameArena(&frameMemory); }
+
+    // General purpose heap over the permanent storage, for data that lives
+    // as long as the application.
+    tlsf_heap *GetPermanentHeap() { return &permanentHeap; }
+
     virtual bool Init() = 0;
     virtual void Shutdown() = 0;
     virtual void UpdateGameLogic() = 0;
@@ -46,9 +57,23 @@ protected:
     double timer;
     double frameTimer;
 
+    // Allocated by RunGameApplication, permanent storage is handed out by
+    // permanentHeap and per thread scratch memory is carved out of the
+    // transient pool
+    game_memory gameMemory;
+    memory_pool transientPool;
+    tlsf_heap permanentHeap;
+
+    // Flipped at the start of every frame by MainLoop, renderCommands is
+    // pushed to the frame memory and executed after Render
+    frame_memory frameMemory;
+    render_command_buffer renderCommands;
+
 private:
     void *glfwWindow;
     GLFWCallbackPointerData callbackData;
+
+    friend int RunGameApplication(GameAppBase *application, uint32_t width, uint32_t height, const char *title);
 };
 
 int RunGameApplication(GameAppBase *application, uint32_t width, uint32_t height, const char *title);
\ No newline at end of file
@@ -57,20 +57,21 @@ bool CreateSkyBoxSurface(std::shared_ptr<renderer::IRenderDevice> device, render
     };
     const size_t vertexLayoutStride = sizeof(float) * 3;
 
+    renderer::RenderResources *resources = device->GetResources();
     surface.Clear();
     surface.drawStateFlags = DrawState_DepthTest_LessEqual | DrawState_Cull_CW;
-    surface.vertexBuffer = device->CreateBuffer(Buffer_Vertex | Buffer_ReadOnly, skyboxVertices, sizeof(skyboxVertices));
-    surface.vertexDeclaration = device->CreateVertexDelclaration(vertexLayout, vertexLayoutStride);
+    surface.vertexBuffer = resources->buffers.Add(device->CreateBuffer(Buffer_Vertex | Buffer_ReadOnly, skyboxVertices, sizeof(skyboxVertices)));
+    surface.vertexDeclaration = resources->vertexDeclarations.Add(device->CreateVertexDelclaration(vertexLayout, vertexLayoutStride));
     surface.primitiveCount = 36;
 
-    surface.material.texture[0] = renderer::globalTextureCache->LoadTextureCubeFromFiles(textureFileNames);
+    surface.material.texture[0] = resources->textures.Add(renderer::globalTextureCache->LoadTextureCubeFromFiles(textureFileNames));
     RETURN_FALSE_IF(!surface.material.texture[0]);
-    surface.material.sampler[0] = device->CreateSamplerState(renderer::SamplerStateInitializer(
+    surface.material.sampler[0] = resources->samplerStates.Add(device->CreateSamplerState(renderer::SamplerStateInitializer(
         SamplerFilter_Anisotropic,
         SamplerWrap_Clamp,
         SamplerWrap_Clamp,
         SamplerWrap_Clamp
-    ));
+    )));
 
     return true;
 }
\ No newline at end of file
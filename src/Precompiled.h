@@ -13,7 +13,7 @@
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#ifndef NDEBUG
+#if defined(_WIN32) && !defined(NDEBUG)
 #define CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
@@ -0,0 +1,120 @@
+#include "Precompiled.h"
+#include "Base/JobCoroutine.h"
+#include "Base/File.h"
+#include "Base/Sys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+
+// Runs job_task, WaitForCounterAsync and ReadFileInBackgroundJob on a real
+// job queue. Built as C++20 by CMake, the engine core stays C++14.
+#if !JOB_COROUTINES_SUPPORTED
+#error "JobCoroutineTest needs a compiler with C++20 coroutines"
+#endif
+
+#define TEST_NUM_THREADS            4
+#define TEST_NUM_TASKS              200
+#define TEST_CHILD_JOBS_PER_TASK    16
+#define TEST_FILENAME               "JobCoroutineTest.tmp"
+
+static std::atomic<uint32_t> NumFailures(0);
+
+#define TEST_CHECK(expression) \
+    if (!(expression)) { Sys_Printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #expression); ++NumFailures; }
+
+static std::atomic<uint32_t> NumChildJobsRun(0);
+static std::atomic<uint32_t> NumTasksFinished(0);
+
+static void ChildJob(void *Data)
+{
+    std::atomic<uint32_t> *TaskChildren = (std::atomic<uint32_t> *)Data;
+    TaskChildren->fetch_add(1, std::memory_order_relaxed);
+    NumChildJobsRun.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The counter lives in the coroutine frame, so the task must not run on
+// before the last child is done with it
+static job_task WaitForChildrenTask(parallel_job_queue *Queue, job_priority Priority)
+{
+    std::atomic<uint32_t> TaskChildren(0);
+    job_counter Counter;
+    for (uint32_t Child = 0; Child < TEST_CHILD_JOBS_PER_TASK; ++Child)
+    {
+        SubmitJob(Queue, ChildJob, &TaskChildren, &Counter);
+    }
+
+    co_await WaitForCounterAsync(Queue, &Counter);
+    TEST_CHECK(TaskChildren.load() == TEST_CHILD_JOBS_PER_TASK);
+    TEST_CHECK(GetCurrentJobPriority() == Priority);
+
+    // Waiting on a counter that is already done doesn't suspend
+    co_await WaitForCounterAsync(Queue, &Counter);
+    NumTasksFinished.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The read runs as a background job, what follows has to continue at the
+// priority of the task and not on the background worker
+static job_task ReadFileTask(parallel_job_queue *Queue, job_priority Priority, const std::vector<uint8_t> *Expected)
+{
+    std::vector<uint8_t> FileBuffer;
+    const bool Succeeded = co_await ReadFileInBackgroundJob(Queue, TEST_FILENAME, &FileBuffer);
+    TEST_CHECK(Succeeded);
+    TEST_CHECK(FileBuffer == *Expected);
+    TEST_CHECK(GetCurrentJobPriority() == Priority);
+
+    std::vector<uint8_t> MissingBuffer;
+    const bool MissingSucceeded = co_await ReadFileInBackgroundJob(Queue, "JobCoroutineTest.missing", &MissingBuffer);
+    TEST_CHECK(!MissingSucceeded);
+    TEST_CHECK(GetCurrentJobPriority() == Priority);
+    NumTasksFinished.fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool WriteTestFile(const std::vector<uint8_t> &Contents)
+{
+    SysFile File(TEST_FILENAME, FileOpen_WriteTruncate);
+    return File.IsValid() && File.Write(Contents.data(), Contents.size()) == Contents.size();
+}
+
+int main()
+{
+    std::vector<uint8_t> Contents(100000);
+    for (size_t Index = 0; Index < Contents.size(); ++Index)
+    {
+        Contents[Index] = (uint8_t)(Index * 31 + 7);
+    }
+
+    if (!WriteTestFile(Contents))
+    {
+        Sys_Printf("JobCoroutineTest: couldn't write %s\n", TEST_FILENAME);
+        return EXIT_FAILURE;
+    }
+
+    parallel_job_queue Queue;
+    CreateParallelJobQueue(&Queue, TEST_NUM_THREADS);
+
+    job_counter Counter;
+    const job_priority Priorities[] = { JobPriority_FrameCritical, JobPriority_Normal };
+    for (uint32_t Task = 0; Task < TEST_NUM_TASKS; ++Task)
+    {
+        const job_priority Priority = Priorities[Task % 2];
+        SubmitJobTask(&Queue, WaitForChildrenTask(&Queue, Priority), &Counter, Priority);
+        SubmitJobTask(&Queue, ReadFileTask(&Queue, Priority, &Contents), &Counter, Priority);
+    }
+
+    WaitForCounter(&Queue, &Counter);
+    TEST_CHECK(NumTasksFinished.load() == 2 * TEST_NUM_TASKS);
+    TEST_CHECK(NumChildJobsRun.load() == TEST_NUM_TASKS * TEST_CHILD_JOBS_PER_TASK);
+
+    // Tasks that are never submitted are destroyed with their job_task
+    {
+        job_task Unsubmitted = WaitForChildrenTask(&Queue, JobPriority_Normal);
+    }
+
+    WaitForQueueToFinish(&Queue);
+    DestroyParallelJobQueue(&Queue);
+    remove(TEST_FILENAME);
+
+    Sys_Printf("JobCoroutineTest: %s\n", NumFailures.load() ? "failed" : "passed");
+    return NumFailures.load() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
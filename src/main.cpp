@@ -23,7 +23,7 @@ public:
     virtual ~GameApp() {}
    
     virtual bool Init();
-    virtual void Shutdown() {}
+    virtual void Shutdown();
     virtual void UpdateGameLogic();
     virtual void Render();
 
@@ -43,37 +43,33 @@ private:
 void PrintStringJob(void *data)
 {
     const char *str = (const char *)data;
-    Sys_Printf("Thread %u: %s\n", GetThreadID(), str);
+    Sys_Printf("Thread %u: %s\n", GetJobThreadIndex(), str);
 }
 
 bool GameApp::Init()
 {
-    parallel_job_queue Queue;
-    CreateParallelJobQueue(&Queue, 8);
-    Sys_Sleep(1);
-
-    SubmitJob(&Queue, &PrintStringJob, "String00");
-    SubmitJob(&Queue, &PrintStringJob, "String01");
-    SubmitJob(&Queue, &PrintStringJob, "String02");
-    SubmitJob(&Queue, &PrintStringJob, "String03");
-    SubmitJob(&Queue, &PrintStringJob, "String04");
-    SubmitJob(&Queue, &PrintStringJob, "String05");
-    SubmitJob(&Queue, &PrintStringJob, "String07");
-    SubmitJob(&Queue, &PrintStringJob, "String08");
-    SubmitJob(&Queue, &PrintStringJob, "String09");
-
-    SubmitJob(&Queue, &PrintStringJob, "String10");
-    SubmitJob(&Queue, &PrintStringJob, "String11");
-    SubmitJob(&Queue, &PrintStringJob, "String12");
-    SubmitJob(&Queue, &PrintStringJob, "String13");
-    SubmitJob(&Queue, &PrintStringJob, "String14");
-    SubmitJob(&Queue, &PrintStringJob, "String15");
-    SubmitJob(&Queue, &PrintStringJob, "String16");
-    SubmitJob(&Queue, &PrintStringJob, "String17");
-    SubmitJob(&Queue, &PrintStringJob, "String18");
-    SubmitJob(&Queue, &PrintStringJob, "String19");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String00");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String01");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String02");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String03");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String04");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String05");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String07");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String08");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String09");
+
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String10");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String11");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String12");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String13");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String14");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String15");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String16");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String17");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String18");
+    SubmitNamedJob(GlobalJobQueue, "PrintStringJob", &PrintStringJob, "String19");
     
-    WaitForQueueToFinish(&Queue);
+    WaitForQueueToFinish(GlobalJobQueue);
 
     program = renderer::CreateShaderProgramFromFiles(renderDevice, "assets/shaders/blinn-phong-bump.vert", "assets/shaders/blinn-phong-bump.frag");
     RETURN_FALSE_IF(!program);
@@ -125,6 +121,12 @@ bool GameApp::Init()
     return true;
 }
 
+void GameApp::Shutdown()
+{
+    renderer::ReleaseSurfaceResources(renderDevice->GetResources(), skyboxSurface);
+    skyboxSurface.Clear();
+}
+
 void GameApp::UpdateGameLogic()
 {
     static char titleBuffer[64] = {};
@@ -173,7 +175,9 @@ void GameTestRender(render_command_buffer *RenderCommands)
 
 int main()
 {
+#if defined(_WIN32) && !defined(NDEBUG)
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
 
     game_entry_params Params = {};
     Params.PermanentStorageSize = Megabytes(256);
@@ -5,80 +5,93 @@
 #include "Renderer/Model_obj.h"
 #include "Base/Debug.h"
 #include "Base/Algorithm.h"
+#include "Base/Memory.h"
+#include "Base/Sys.h"
+
+#define OBJ_IMPORT_MEMORY_SIZE      Gigabytes(1)
+#define OBJ_IMPORT_COMMIT_SIZE      Megabytes(2)
 
 namespace renderer
 {
 
-Model::Model(const std::string &inName)
+Model::Model(const std::string &inName, std::shared_ptr<renderer::IRenderDevice> inDevice) :
+    device(inDevice)
 {
     InitEmpty(inName);
 }
 
 Model::~Model()
 {
+    ReleaseSurfaces();
 }
 
 void Model::InitEmpty(const std::string &inName)
 {
     name = inName;
-    surfaceList.clear();
+    ReleaseSurfaces();
 }
 
-void Model::AddSurface(renderer::Surface surf)
+void Model::AddSurface(const renderer::Surface &surf)
 {
     surfaceList.push_back(surf);
 }
 
-void Model::Render(std::shared_ptr<renderer::IRenderDevice> device, const ICamera *camera)
+void Model::ReleaseSurfaces()
 {
+    RenderResources *resources = device->GetResources();
     for (const auto &surf : surfaceList)
     {
-        device->Render(&surf, camera);
+        ReleaseSurfaceResources(resources, surf);
     }
+
+    surfaceList.clear();
 }
 
-std::shared_ptr<Model> LoadOBJModel(std::shared_ptr<renderer::IRenderDevice> device, const std::string &filename)
+void Model::Render(std::shared_ptr<renderer::IRenderDevice> device, const ICamera *camera)
 {
-    static const renderer::VertexElementList vertexElements = 
+    for (const auto &surf : surfaceList)
     {
-        { VertexElement(VertexElementUsage_Position,  VertexElementFormat_Float3, offsetof(OBJ_Vertex, position)) },
-        { VertexElement(VertexElementUsage_Normal,    VertexElementFormat_Float3, offsetof(OBJ_Vertex, normal))   },
-        { VertexElement(VertexElementUsage_Tangent,   VertexElementFormat_Float3, offsetof(OBJ_Vertex, tangent))  },
-        { VertexElement(VertexElementUsage_TexCoord0, VertexElementFormat_Float2, offsetof(OBJ_Vertex, texCoord)) }
-    };
-    auto vertexDeclaration = device->CreateVertexDelclaration(vertexElements, sizeof(OBJ_Vertex));
+        device->Render(&surf, camera);
+    }
+}
 
-    auto rawObjModel = OBJ_LoadModel(filename);
+static std::shared_ptr<Model> UploadOBJModel(std::shared_ptr<renderer::IRenderDevice> device,
+                                             std::shared_ptr<IVertexDeclaration> vertexDeclaration,
+                                             const std::string &filename,
+                                             memory_pool *importPool)
+{
+    auto rawObjModel = OBJ_LoadModel(filename, importPool);
     RETURN_NULL_IF(!rawObjModel);
 
-    auto objModel = OBJ_CompileRawModel(rawObjModel);
-    auto model = std::make_shared<Model>(objModel->name);
+    auto objModel = OBJ_CompileRawModel(rawObjModel, importPool);
+    auto model = std::make_shared<Model>(objModel->name, device);
+    RenderResources *resources = device->GetResources();
 
     for (auto &objSurface : objModel->surfaces)
     {
         renderer::Surface surface;
 
         surface.Clear();
-        surface.vertexBuffer = device->CreateBuffer(Buffer_Vertex | Buffer_ReadOnly, &objSurface.vertices[0], sizeof(OBJ_Vertex) * objSurface.vertices.size());
-        surface.vertexDeclaration = vertexDeclaration;
-        surface.indexBuffer = device->CreateBuffer(Buffer_Index | Buffer_32BitIndex | Buffer_ReadOnly, &objSurface.indices[0], sizeof(uint32_t) * objSurface.indices.size());
+        surface.vertexBuffer = resources->buffers.Add(device->CreateBuffer(Buffer_Vertex | Buffer_ReadOnly, &objSurface.vertices[0], sizeof(OBJ_Vertex) * objSurface.vertices.size()));
+        surface.vertexDeclaration = resources->vertexDeclarations.Add(vertexDeclaration);
+        surface.indexBuffer = resources->buffers.Add(device->CreateBuffer(Buffer_Index | Buffer_32BitIndex | Buffer_ReadOnly, &objSurface.indices[0], sizeof(uint32_t) * objSurface.indices.size()));
         surface.numVertices = (uint32_t)objSurface.vertices.size();
         surface.numIndices = (uint32_t)objSurface.indices.size();
 
         renderer::SurfaceMaterial *mat = &surface.material;
         if (!objSurface.material.diffuseTexture.empty())
         {
-            mat->texture[0] = renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.diffuseTexture.c_str());
+            mat->texture[0] = resources->textures.Add(renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.diffuseTexture.c_str()));
         }
 
         if (!objSurface.material.specularTexture.empty())
         {
-            mat->texture[1] = renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.specularTexture.c_str());
+            mat->texture[1] = resources->textures.Add(renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.specularTexture.c_str()));
         }
 
         if (!objSurface.material.bumpTexture.empty())
         {
-            mat->texture[2] = renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.bumpTexture.c_str());
+            mat->texture[2] = resources->textures.Add(renderer::globalTextureCache->LoadTexture2DFromFile(objSurface.material.bumpTexture.c_str()));
         }
 
         mat->ambient = objSurface.material.ambientColor;
@@ -93,4 +106,27 @@ std::shared_ptr<Model> LoadOBJModel(std::shared_ptr<renderer::IRenderDevice> dev
     return model;
 }
 
+std::shared_ptr<Model> LoadOBJModel(std::shared_ptr<renderer::IRenderDevice> device, const std::string &filename)
+{
+    MEMORY_TAG_SCOPE(MemoryTag_OBJ);
+    static const renderer::VertexElementList vertexElements = 
+    {
+        { VertexElement(VertexElementUsage_Position,  VertexElementFormat_Float3, offsetof(OBJ_Vertex, position)) },
+        { VertexElement(VertexElementUsage_Normal,    VertexElementFormat_Float3, offsetof(OBJ_Vertex, normal))   },
+        { VertexElement(VertexElementUsage_Tangent,   VertexElementFormat_Float3, offsetof(OBJ_Vertex, tangent))  },
+        { VertexElement(VertexElementUsage_TexCoord0, VertexElementFormat_Float2, offsetof(OBJ_Vertex, texCoord)) }
+    };
+    auto vertexDeclaration = device->CreateVertexDelclaration(vertexElements, sizeof(OBJ_Vertex));
+
+    // everything but the uploaded model is released at once with the import memory
+    void *importMemory = Sys_Reserve(OBJ_IMPORT_MEMORY_SIZE, SYS_RESERVE_HUGE_PAGES);
+    RETURN_NULL_IF(!importMemory);
+    memory_pool importPool;
+    InitializeReservedMemoryPool(&importPool, OBJ_IMPORT_MEMORY_SIZE, importMemory, OBJ_IMPORT_COMMIT_SIZE);
+
+    auto model = UploadOBJModel(device, vertexDeclaration, filename, &importPool);
+    Sys_Free(importMemory);
+    return model;
+}
+
 } // engine
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "RenderDevice.h"
+#include "Base/Memory.h"
 
 namespace renderer
 {
@@ -7,17 +8,22 @@ namespace renderer
 class Model
 {
 public:
-    Model(const std::string &inName);
+    Model(const std::string &inName, std::shared_ptr<renderer::IRenderDevice> inDevice);
     ~Model();
 
     void InitEmpty(const std::string &inName);
     const std::string &GetName() const { return name; }
-    void AddSurface(renderer::Surface surf);
+
+    // The model takes over the resource references of the surface.
+    void AddSurface(const renderer::Surface &surf);
     void Render(std::shared_ptr<renderer::IRenderDevice> device, const ICamera *camera);
 
 private:
+    void ReleaseSurfaces();
+
     std::string name;
-    std::list<renderer::Surface> surfaceList;
+    std::shared_ptr<renderer::IRenderDevice> device;
+    std::list<renderer::Surface, BlockPoolAllocator<renderer::Surface>> surfaceList;
 };
 
 std::shared_ptr<Model> LoadOBJModel(std::shared_ptr<renderer::IRenderDevice> device, const std::string &filename);
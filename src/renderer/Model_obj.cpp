@@ -3,6 +3,8 @@
 #include "Base/Debug.h"
 #include "Base/File.h"
 #include "Base/MurmurHash.h"
+#include "Base/ParallelJobQueue.h"
+#include "Base/Container/FlatHashMap.h"
 
 #define LINEBUFFER_SIZE         1024
 #define DEFAULT_MODEL_NAME      "<unknown>"
@@ -111,17 +113,18 @@ OBJ_Edge ReadFaceIndex(const char *&token)
     return OBJ_Edge(vertexIndex, texCoordIndex);
 }
 
-OBJ_Face ReadFace(const char *&buffer)
+void ReadFace(const char *&buffer, OBJ_FaceGroup *faceGroup)
 {
-    OBJ_Face face;
-
+    assert(faceGroup->edges.size() < UINT32_MAX);
+    OBJ_Face face((uint32_t)faceGroup->edges.size());
     while (buffer[0] != '\r' && buffer[0] != '\n' && buffer[0] != '\0')
     {
-        face.edges.emplace_back(ReadFaceIndex(buffer));
+        faceGroup->edges.emplace_back(ReadFaceIndex(buffer));
         buffer += strspn(buffer, " \t");
+        ++face.numEdges;
     }
 
-    return face;
+    faceGroup->faces.push_back(face);
 }
 
 OBJ_Material CreateDefaultMaterial(const std::string &name)
@@ -232,57 +235,70 @@ bool MTL_Load(const char *filename, OBJ_MaterialMap &outMaterials)
 
 void CalculateNormalsAndTangents(std::shared_ptr<OBJ_RawModel> rawModel)
 {
+    OBJ_Array<Vec3f> faceTangents(MemoryPoolAllocator<Vec3f>(rawModel->pool));
+
     for (auto &faceGroup : rawModel->faceGroups)
     {
-        for (auto &face : faceGroup.faces)
+        // face normals and tangents are independent of each other, calculate those
+        // in parallel and accumulate them on the shared vertices afterwards
+        faceTangents.resize(faceGroup.faces.size());
+        ParallelFor(GlobalJobQueue, 0, (uint32_t)faceGroup.faces.size(), 1024, [&](uint32_t faceIndex)
         {
-            assert(face.edges.size() >= 3);
-            const OBJ_PosNormalTangentVertex &a = rawModel->vertices[face.edges[0].vertexIndex - 1];
-            const OBJ_PosNormalTangentVertex &b = rawModel->vertices[face.edges[1].vertexIndex - 1];
-            const OBJ_PosNormalTangentVertex &c = rawModel->vertices[face.edges[2].vertexIndex - 1];
+            OBJ_Face &face = faceGroup.faces[faceIndex];
+            const OBJ_Edge *faceEdges = faceGroup.GetFaceEdges(face);
+            assert(face.numEdges >= 3);
+            const OBJ_PosNormalTangentVertex &a = rawModel->vertices[faceEdges[0].vertexIndex - 1];
+            const OBJ_PosNormalTangentVertex &b = rawModel->vertices[faceEdges[1].vertexIndex - 1];
+            const OBJ_PosNormalTangentVertex &c = rawModel->vertices[faceEdges[2].vertexIndex - 1];
             const Vec3f v1 = b.pos - a.pos;
             const Vec3f v2 = c.pos - a.pos;
             face.normal = CrossProduct(v1, v2);
 
             glm::vec2 st1 = glm::vec2(0, 1) - glm::vec2(0, 0);
             glm::vec2 st2 = glm::vec2(1, 1) - glm::vec2(0, 0);
-            bool faceHasTexCoords = (face.edges[0].texCoordIndex && face.edges[1].texCoordIndex && face.edges[2].texCoordIndex);
+            bool faceHasTexCoords = (faceEdges[0].texCoordIndex && faceEdges[1].texCoordIndex && faceEdges[2].texCoordIndex);
             if (faceHasTexCoords)
             {
                 // align tangent with texCoords
-                const glm::vec2 &ta = rawModel->texCoords[face.edges[0].texCoordIndex - 1];
-                const glm::vec2 &tb = rawModel->texCoords[face.edges[1].texCoordIndex - 1];
-                const glm::vec2 &tc = rawModel->texCoords[face.edges[2].texCoordIndex - 1];
+                const glm::vec2 &ta = rawModel->texCoords[faceEdges[0].texCoordIndex - 1];
+                const glm::vec2 &tb = rawModel->texCoords[faceEdges[1].texCoordIndex - 1];
+                const glm::vec2 &tc = rawModel->texCoords[faceEdges[2].texCoordIndex - 1];
                 st1 = tb - ta;
                 st2 = tc - ta;           
             }
   
             const float tangentCoef = 1.0f / (st1.s * st2.t - st2.s * st1.t);
-            const Vec3f tangent = (v1 * st2.y - v2 * st1.y) * tangentCoef;
+            faceTangents[faceIndex] = (v1 * st2.y - v2 * st1.y) * tangentCoef;
+        });
 
-            for (const auto &edge : face.edges)
+        for (size_t faceIndex = 0; faceIndex < faceGroup.faces.size(); ++faceIndex)
+        {
+            const OBJ_Face &face = faceGroup.faces[faceIndex];
+            const OBJ_Edge *faceEdges = faceGroup.GetFaceEdges(face);
+            for (uint32_t edgeIndex = 0; edgeIndex < face.numEdges; ++edgeIndex)
             {
-                rawModel->vertices[edge.vertexIndex - 1].normal += face.normal;
-                rawModel->vertices[edge.vertexIndex - 1].tangent += tangent;
+                rawModel->vertices[faceEdges[edgeIndex].vertexIndex - 1].normal += face.normal;
+                rawModel->vertices[faceEdges[edgeIndex].vertexIndex - 1].tangent += faceTangents[faceIndex];
             }
         }
     }
 
-    for (auto &vertex : rawModel->vertices)
+    ParallelFor(GlobalJobQueue, 0, (uint32_t)rawModel->vertices.size(), 4096, [&](uint32_t vertexIndex)
     {
+        OBJ_PosNormalTangentVertex &vertex = rawModel->vertices[vertexIndex];
         vertex.normal = Normalize(vertex.normal);
         vertex.tangent = Normalize(vertex.tangent);
-    }
+    });
 }
 
 // TODO: Clean up material handling code
-std::shared_ptr<OBJ_RawModel> OBJ_LoadModel(const std::string &filename)
+std::shared_ptr<OBJ_RawModel> OBJ_LoadModel(const std::string &filename, memory_pool *pool)
 {
     SysFile objFile(filename, FileOpen_Read);
     RETURN_NULL_IF(!objFile.IsValid());
 
     DebugPrintf("Loading %s...\n", filename.c_str());
-    auto rawModel = std::make_shared<OBJ_RawModel>(DEFAULT_MODEL_NAME);
+    auto rawModel = std::make_shared<OBJ_RawModel>(DEFAULT_MODEL_NAME, pool);
     OBJ_FaceGroup *rawFaceGroup = rawModel->AddEmptyFaceGroup(DEFAULT_FACEGROUP_NAME);
     std::string mtllibPath("");
 
@@ -319,8 +335,7 @@ std::shared_ptr<OBJ_RawModel> OBJ_LoadModel(const std::string &filename)
         }
         else if (ReadToken(linebuf, "f "))
         {
-            const OBJ_Face face = ReadFace(linebuf);  
-            rawFaceGroup->faces.push_back(face);
+            ReadFace(linebuf, rawFaceGroup);
         } 
         else if (ReadToken(linebuf, "o "))
         {
@@ -370,36 +385,62 @@ bool operator<(const OBJ_Edge &a, const OBJ_Edge &b)
     return false;
 }
 
-std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ_RawModel> rawModel)
+std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ_RawModel> rawModel, memory_pool *pool)
 {
-    auto compiledModel = std::make_shared<OBJ_CompiledModel>(rawModel->name);
+    auto compiledModel = std::make_shared<OBJ_CompiledModel>(rawModel->name, pool);
 
+    // create a tri surface for each facegroup up front, looking up materials
+    // modifies the material map so it can't be done from the compile jobs.
+    // The pool isn't thread safe either, reserve room for every triangle so
+    // the jobs never allocate from it.
+    compiledModel->surfaces.reserve(rawModel->faceGroups.size());
     for (const auto &faceGroup : rawModel->faceGroups)
     {
-        std::unordered_map<OBJ_Edge, OBJ_Index, OBJ_EdgeHasher> vertexCache;
-
-        // get the material name
         const auto materialSearch = rawModel->materials.find(faceGroup.materialName);
         const std::string materialName = (materialSearch != rawModel->materials.end()) ? faceGroup.materialName : DEFAULT_MATERIAL_NAME;
-        
-        // create a new tri surface for the facegroup
-        OBJ_TriSurface triSurface(faceGroup.name, rawModel->materials[materialName]);
+        compiledModel->surfaces.emplace_back(faceGroup.name, rawModel->materials[materialName], pool);
+
+        size_t numIndices = 0;
+        for (const auto &face : faceGroup.faces)
+        {
+            numIndices += face.numEdges > 2 ? (face.numEdges - 2) * 3 : 0;
+        }
+
+        OBJ_TriSurface &triSurface = compiledModel->surfaces.back();
+        triSurface.indices.reserve(numIndices);
+        triSurface.vertices.reserve(numIndices);
+    }
+
+    // facegroups compile into separate surfaces, so each one can be its own job
+    ParallelFor(GlobalJobQueue, 0, (uint32_t)rawModel->faceGroups.size(), 1, [&](uint32_t faceGroupIndex)
+    {
+        const OBJ_FaceGroup &faceGroup = rawModel->faceGroups[faceGroupIndex];
+        OBJ_TriSurface &triSurface = compiledModel->surfaces[faceGroupIndex];
+
+        // the vertex cache only lives for this job, keep it in the scratch pool of the thread.
+        // every face adds about one new vertex in a closed mesh, reserve for that
+        typedef std::pair<OBJ_Edge, OBJ_Index> VertexCacheEntry;
+        scoped_scratch_memory scratchMemory;
+        FlatHashMap<OBJ_Edge, OBJ_Index, OBJ_EdgeHasher, std::equal_to<OBJ_Edge>, MemoryPoolAllocator<VertexCacheEntry>> vertexCache(
+            MemoryPoolAllocator<VertexCacheEntry>(scratchMemory.Pool));
+        vertexCache.reserve(faceGroup.faces.size());
 
         for (const auto &face : faceGroup.faces)
         {
+            const OBJ_Edge *faceEdges = faceGroup.GetFaceEdges(face);
             OBJ_Edge triangleEdges[3] = 
             {
-                face.edges[0],
+                faceEdges[0],
                 {0, 0},
-                face.edges[1]
+                faceEdges[1]
             };
 
             // Polygon -> triangle fan conversion
-            const size_t numEdges = face.edges.size();
+            const size_t numEdges = face.numEdges;
             for (size_t k = 2; k < numEdges; ++k)
             {
                 triangleEdges[1] = triangleEdges[2];
-                triangleEdges[2] = face.edges[k];
+                triangleEdges[2] = faceEdges[k];
 
                 for (const auto &edge : triangleEdges)
                 {
@@ -412,7 +453,7 @@ std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ
                     else
                     {
                         // create vertices not found in cache and insert them
-                        const uint16_t idx = static_cast<uint16_t>(triSurface.vertices.size());
+                        const OBJ_Index idx = static_cast<OBJ_Index>(triSurface.vertices.size());
                         vertexCache[edge] = idx;
 
                         const OBJ_PosNormalTangentVertex &vertex = rawModel->vertices[edge.vertexIndex - 1];
@@ -426,9 +467,7 @@ std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ
                 }
             }
         }
-
-        compiledModel->surfaces.push_back(triSurface);
-    }
+    });
 
     return compiledModel;
 }
@@ -1,12 +1,17 @@
 #pragma once
 #include "Base/Math/Vector.h"
 #include "renderer/RenderDevice.h"
+#include "Base/Memory.h"
 
 namespace renderer
 {
 
 typedef uint32_t OBJ_Index;
 
+// Bulk data of an import lives in a memory pool that is released at once
+// after the model is uploaded.
+template <class T> using OBJ_Array = std::vector<T, MemoryPoolAllocator<T>>;
+
 struct OBJ_Edge
 {
     OBJ_Edge(const OBJ_Index inVertexIndex, const OBJ_Index inTexCoordIndex) :
@@ -19,22 +24,36 @@ struct OBJ_Edge
     OBJ_Index texCoordIndex;
 };
 
+// The edges of a face are a range of the edge array of its face group,
+// so reading a face doesn't allocate.
 struct OBJ_Face
 {
-    std::vector<OBJ_Edge> edges;
+    OBJ_Face(const uint32_t inFirstEdge) :
+        firstEdge(inFirstEdge),
+        numEdges(0)
+    {
+    }
+
+    uint32_t firstEdge;
+    uint32_t numEdges;
     Vec3f normal;
 };
 
 struct OBJ_FaceGroup
 {
-    OBJ_FaceGroup(const std::string &faceGroupName) :
-        name(faceGroupName)
+    OBJ_FaceGroup(const std::string &faceGroupName, memory_pool *pool) :
+        name(faceGroupName),
+        faces(MemoryPoolAllocator<OBJ_Face>(pool)),
+        edges(MemoryPoolAllocator<OBJ_Edge>(pool))
     {
     }
 
+    const OBJ_Edge *GetFaceEdges(const OBJ_Face &face) const { return &edges[face.firstEdge]; }
+
     std::string name;
     std::string materialName;
-    std::vector<OBJ_Face> faces;
+    OBJ_Array<OBJ_Face> faces;
+    OBJ_Array<OBJ_Edge> edges;
 };
 
 struct OBJ_Material
@@ -71,8 +90,12 @@ struct OBJ_PosNormalTangentVertex
 
 struct OBJ_RawModel
 {
-    OBJ_RawModel(const std::string &inName) :
-        name(inName)
+    OBJ_RawModel(const std::string &inName, memory_pool *inPool) :
+        name(inName),
+        pool(inPool),
+        vertices(MemoryPoolAllocator<OBJ_PosNormalTangentVertex>(inPool)),
+        texCoords(MemoryPoolAllocator<glm::vec2>(inPool)),
+        faceGroups(MemoryPoolAllocator<OBJ_FaceGroup>(inPool))
     {
     }
 
@@ -84,16 +107,17 @@ struct OBJ_RawModel
             faceGroups.back().name = faceGroupName;
         } else
         {
-            faceGroups.emplace_back(faceGroupName);
+            faceGroups.emplace_back(faceGroupName, pool);
         }
 
         return &faceGroups.back();
     }
 
     std::string name;
-    std::vector<OBJ_PosNormalTangentVertex> vertices;
-    std::vector<glm::vec2> texCoords;       // texCoords are held oudside vertices sence a vertex can have more than one texCoord in an .obj
-    std::vector<OBJ_FaceGroup> faceGroups;
+    memory_pool *pool;
+    OBJ_Array<OBJ_PosNormalTangentVertex> vertices;
+    OBJ_Array<glm::vec2> texCoords;         // texCoords are held oudside vertices sence a vertex can have more than one texCoord in an .obj
+    OBJ_Array<OBJ_FaceGroup> faceGroups;
     OBJ_MaterialMap materials;
 };
 
@@ -119,30 +143,35 @@ struct OBJ_Vertex
 
 struct OBJ_TriSurface
 {
-    OBJ_TriSurface(const std::string &inName, const OBJ_Material &inMaterial) :
+    OBJ_TriSurface(const std::string &inName, const OBJ_Material &inMaterial, memory_pool *pool) :
         name(inName),
+        vertices(MemoryPoolAllocator<OBJ_Vertex>(pool)),
+        indices(MemoryPoolAllocator<OBJ_Index>(pool)),
         material(inMaterial)
     {
     }
 
     std::string name;
-    std::vector<OBJ_Vertex> vertices;
-    std::vector<OBJ_Index> indices;
+    OBJ_Array<OBJ_Vertex> vertices;
+    OBJ_Array<OBJ_Index> indices;
     OBJ_Material material;
 };
 
 struct OBJ_CompiledModel
 {
-    OBJ_CompiledModel(const std::string &inName) :
-        name(inName)
+    OBJ_CompiledModel(const std::string &inName, memory_pool *pool) :
+        name(inName),
+        surfaces(MemoryPoolAllocator<OBJ_TriSurface>(pool))
     {
     }
 
     std::string name;
-    std::vector<OBJ_TriSurface> surfaces;
+    OBJ_Array<OBJ_TriSurface> surfaces;
 };
 
-std::shared_ptr<OBJ_RawModel> OBJ_LoadModel(const std::string &filename);
-std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ_RawModel> rawModel);
+// Models are loaded and compiled into pool, which is not thread safe. The
+// models have to be destroyed before the pool is released.
+std::shared_ptr<OBJ_RawModel> OBJ_LoadModel(const std::string &filename, memory_pool *pool);
+std::shared_ptr<OBJ_CompiledModel> OBJ_CompileRawModel(const std::shared_ptr<OBJ_RawModel> rawModel, memory_pool *pool);
 
 } // engine
\ No newline at end of file
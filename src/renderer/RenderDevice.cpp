@@ -3,6 +3,7 @@
 #include "Base/Debug.h"
 #include "Base/File.h"
 #include "Base/MurmurHash.h"
+#include "Base/Memory.h"
 #include "Base/Algorithm.h"
 
 namespace renderer
@@ -50,6 +51,7 @@ ShaderBytecodeFromFile::~ShaderBytecodeFromFile()
 
 std::shared_ptr<IShaderProgram> CreateShaderProgramFromFiles(std::shared_ptr<IRenderDevice> device, const char *VSFilename, const char *FSFilename)
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Renderer);
     ShaderBytecodeFromFile VS(VSFilename);
     ShaderBytecodeFromFile FS(FSFilename);
 
@@ -59,6 +61,7 @@ std::shared_ptr<IShaderProgram> CreateShaderProgramFromFiles(std::shared_ptr<IRe
 
 std::shared_ptr<IShaderProgram> CreateShaderProgramFromFiles(std::shared_ptr<IRenderDevice> device, const char *VSFilename, const char *GSFilename, const char *FSFilename)
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Renderer);
     ShaderBytecodeFromFile VS(VSFilename);
     ShaderBytecodeFromFile GS(GSFilename);
     ShaderBytecodeFromFile FS(FSFilename);
@@ -80,6 +83,34 @@ int CalculateNumMipLevels(uint32_t width, uint32_t height)
     return n;
 }
 
+void RenderResources::CollectGarbage()
+{
+    buffers.CollectGarbage();
+    vertexDeclarations.CollectGarbage();
+    textures.CollectGarbage();
+    samplerStates.CollectGarbage();
+}
+
+void RenderResources::Clear()
+{
+    buffers.Clear();
+    vertexDeclarations.Clear();
+    textures.Clear();
+    samplerStates.Clear();
+}
+
+void ReleaseSurfaceResources(RenderResources *resources, const Surface &surface)
+{
+    resources->buffers.Release(surface.vertexBuffer);
+    resources->buffers.Release(surface.indexBuffer);
+    resources->vertexDeclarations.Release(surface.vertexDeclaration);
+    for (uint32_t i = 0; i < SurfaceMaterial::MaxNumTextures; ++i)
+    {
+        resources->textures.Release(surface.material.texture[i]);
+        resources->samplerStates.Release(surface.material.sampler[i]);
+    }
+}
+
 size_t SamplerStateInitializerHasher::operator()(const SamplerStateInitializer &state) const
 {
     return CalculateMurmurHash(&state, sizeof(state));
@@ -1,6 +1,7 @@
 #pragma once
 #include "Definitions.h"
 #include "Base/Math/Vector.h"
+#include "ResourcePool.h"
 
 namespace renderer
 {
@@ -190,6 +191,26 @@ private:
     uint32_t height;
 };
 
+//
+// Resource handles
+//
+typedef ResourceHandle<IBuffer>             BufferHandle;
+typedef ResourceHandle<IVertexDeclaration>  VertexDeclarationHandle;
+typedef ResourceHandle<ITexture>            TextureHandle;
+typedef ResourceHandle<ISamplerState>       SamplerStateHandle;
+
+// Resources referenced by surfaces, owned by the render device.
+struct RenderResources
+{
+    ResourcePool<IBuffer> buffers;
+    ResourcePool<IVertexDeclaration> vertexDeclarations;
+    ResourcePool<ITexture> textures;
+    ResourcePool<ISamplerState> samplerStates;
+
+    void CollectGarbage();
+    void Clear();
+};
+
 //
 // Surface structures
 //
@@ -198,20 +219,22 @@ struct SurfaceMaterial
 {
     enum { MaxNumTextures = 4 };
 
-    std::shared_ptr<ISamplerState> sampler[MaxNumTextures];
-    std::shared_ptr<ITexture> texture[MaxNumTextures];
+    SamplerStateHandle sampler[MaxNumTextures];
+    TextureHandle texture[MaxNumTextures];
     Vec3f ambient;
     Vec3f diffuse;
     Vec3f specular;
     float shininess;
 };
 
+// Surfaces hold one reference to each resource they use, surfaces are
+// plain data and copying one doesn't add references.
 struct Surface
 {
     uint32_t drawStateFlags;
-    std::shared_ptr<IBuffer> vertexBuffer;
-    std::shared_ptr<IVertexDeclaration> vertexDeclaration;
-    std::shared_ptr<IBuffer> indexBuffer;
+    BufferHandle vertexBuffer;
+    VertexDeclarationHandle vertexDeclaration;
+    BufferHandle indexBuffer;
     uint32_t numVertices;
     uint32_t numIndices;
     uint32_t primitiveCount;
@@ -220,15 +243,20 @@ struct Surface
     void Clear()
     {
         drawStateFlags = DrawState_Default;
-        vertexBuffer = nullptr;
-        vertexDeclaration = nullptr;
-        indexBuffer = nullptr;
+        vertexBuffer = BufferHandle();
+        vertexDeclaration = VertexDeclarationHandle();
+        indexBuffer = BufferHandle();
         numVertices = UINT32_MAX;
         numIndices = UINT32_MAX;
         primitiveCount = 0;
     }
 };
 
+static_assert(sizeof(Surface) <= 128, "Surfaces should fit in two cache lines");
+
+// Release the references surface holds to its resources.
+void ReleaseSurfaceResources(RenderResources *resources, const Surface &surface);
+
 //
 // Camera Interface
 //
@@ -268,6 +296,10 @@ public:
 
     virtual void Clear(uint32_t targets, const glm::vec4 color, float depth = 1.0f) = 0;
     virtual void Render(const Surface *surf, const ICamera *camera) = 0;
+
+    // Pools for the resources used by surfaces, released resources are
+    // destroyed by RenderResources::CollectGarbage.
+    virtual RenderResources *GetResources() = 0;
 };
 
 std::shared_ptr<IRenderDevice> CreateRenderDevice();
@@ -276,7 +308,7 @@ std::shared_ptr<IRenderDevice> CreateRenderDevice();
 int CalculateNumMipLevels(uint32_t width, uint32_t height);
 
 // SamplerStateInitializer hasher for compatibility with 
-// std::unordered_map<> used by the SamplerState cache.
+// the FlatHashMap<> used by the SamplerState cache.
 struct SamplerStateInitializerHasher
 {
     size_t operator()(const SamplerStateInitializer &state) const;
@@ -5,6 +5,7 @@
 #include "Base/Debug.h"
 #include "Base/Algorithm.h"
 #include "Base/Sys.h"
+#include "Base/Memory.h"
 
 namespace renderer
 {
@@ -333,6 +334,7 @@ void OpenGLRenderDevice::Shutdown()
 {
     if (isInitialized)
     {
+        resources.Clear();
         glDeleteVertexArrays(1, &vaoId);
         isInitialized = false;
     }
@@ -354,7 +356,7 @@ std::shared_ptr<IBuffer> OpenGLRenderDevice::CreateBuffer(int usageFlags, const
     glBindBuffer(target, resource);
     glBufferData(target, size, data, usage);
 
-    return std::make_shared<OpenGLBuffer>(usageFlags, resource, target, usage, size);
+    return std::allocate_shared<OpenGLBuffer>(BlockPoolAllocator<OpenGLBuffer>(), usageFlags, resource, target, usage, size);
 }
 
 std::shared_ptr<IVertexDeclaration> OpenGLRenderDevice::CreateVertexDelclaration(const VertexElementList &vertexElements, size_t stride)
@@ -430,7 +432,8 @@ std::shared_ptr<ITexture2D> OpenGLRenderDevice::CreateTexture2D(int32_t width, i
     glTexImage2D(target, 0, formatInfo->internalFormat, width, height, 0, formatInfo->format, formatInfo->type, data);
     glGenerateMipmap(target);
 
-    auto texture = std::make_shared<OpenGLTexture2D>(
+    auto texture = std::allocate_shared<OpenGLTexture2D>(
+        BlockPoolAllocator<OpenGLTexture2D>(),
         textureId,
         target,
         width,
@@ -473,11 +476,16 @@ std::shared_ptr<ITextureCube> OpenGLRenderDevice::CreateTextureCube(int32_t widt
 }
 
 void OpenGLRenderDevice::SetTexture(uint32_t textureIndex, const std::shared_ptr<ITexture> texture)
+{
+    BindTexture(textureIndex, texture.get());
+}
+
+void OpenGLRenderDevice::BindTexture(uint32_t textureIndex, const ITexture *texture)
 {
     glActiveTexture(GL_TEXTURE0 + textureIndex);
     if (texture != nullptr)
     {
-        std::shared_ptr<OpenGLTexture2D> glTexture = std::static_pointer_cast<OpenGLTexture2D>(texture);
+        const OpenGLTexture2D *glTexture = static_cast<const OpenGLTexture2D *>(texture);
         glBindTexture(glTexture->target, glTexture->resource);
     }
     else
@@ -541,9 +549,14 @@ std::shared_ptr<ISamplerState> OpenGLRenderDevice::CreateSamplerState(const Samp
 }
 
 void OpenGLRenderDevice::SetSamplerState(uint32_t textureIndex, const std::shared_ptr<ISamplerState> state)
+{
+    BindSamplerState(textureIndex, state.get());
+}
+
+void OpenGLRenderDevice::BindSamplerState(uint32_t textureIndex, const ISamplerState *state)
 {
     assert(state);
-    const std::shared_ptr<OpenGLSamplerState> samplerState = std::static_pointer_cast<OpenGLSamplerState>(state);
+    const OpenGLSamplerState *samplerState = static_cast<const OpenGLSamplerState *>(state);
     glActiveTexture(GL_TEXTURE0 + textureIndex);
     glBindSampler(textureIndex, samplerState->resource);
 }
@@ -632,39 +645,46 @@ void OpenGLRenderDevice::Render(const Surface *surf, const ICamera *camera)
     currentShaderProgram->SetVec3(currentShaderProgram->GetParameterLocation("Ks"), material->specular.valuePtr);
     currentShaderProgram->SetFloat(currentShaderProgram->GetParameterLocation("Ns"), material->shininess);
 
-    if (material->texture[0])
+    const ITexture *textures[SurfaceMaterial::MaxNumTextures];
+    for (uint32_t i = 0; i < SurfaceMaterial::MaxNumTextures; ++i)
+    {
+        textures[i] = resources.textures.Get(material->texture[i]);
+    }
+
+    const ISamplerState *sampler = resources.samplerStates.Get(material->sampler[0]);
+    if (textures[0])
     {
-        if (material->sampler[0])
+        if (sampler)
         {
-            SetSamplerState(0, material->sampler[0]);
+            BindSamplerState(0, sampler);
         }
 
-        SetTexture(0, material->texture[0]);    // TODO: Texture state should be manually set by the user!
+        BindTexture(0, textures[0]);    // TODO: Texture state should be manually set by the user!
         glProgramUniform1i(currentShaderProgram->resource, currentShaderProgram->GetParameterLocation("diffuseTexture"), 0);
     }
 
-    if (material->texture[1])
+    if (textures[1])
     {
-        if (material->sampler[0])
+        if (sampler)
         {
-            SetSamplerState(1, material->sampler[0]);
+            BindSamplerState(1, sampler);
         }
 
         currentShaderProgram->SetBool(currentShaderProgram->GetParameterLocation("useSpecularTexture"), true);
-        SetTexture(1, material->texture[1]);
+        BindTexture(1, textures[1]);
         glProgramUniform1i(currentShaderProgram->resource, currentShaderProgram->GetParameterLocation("specularTexture"), 1);
 
     }
 
-    if (material->texture[2])
+    if (textures[2])
     {
-        if (material->sampler[0])
+        if (sampler)
         {
-            SetSamplerState(2, material->sampler[0]);
+            BindSamplerState(2, sampler);
         }
 
         currentShaderProgram->SetBool(currentShaderProgram->GetParameterLocation("useNormalTexture"), true);
-        SetTexture(2, material->texture[2]);
+        BindTexture(2, textures[2]);
         glProgramUniform1i(currentShaderProgram->resource, currentShaderProgram->GetParameterLocation("normalTexture"), 2);
     }
     else
@@ -673,10 +693,12 @@ void OpenGLRenderDevice::Render(const Surface *surf, const ICamera *camera)
     }
 
     // setup geometry
-    const std::shared_ptr<OpenGLBuffer> VBO = std::static_pointer_cast<OpenGLBuffer>(surf->vertexBuffer);
+    const OpenGLBuffer *VBO = static_cast<const OpenGLBuffer *>(resources.buffers.Get(surf->vertexBuffer));
+    assert(VBO && "Stale vertex buffer handle");
     glBindBuffer(VBO->target, VBO->resource);
 
-    const std::shared_ptr<OpenGLVertexDeclaration> vertexDeclaration = std::static_pointer_cast<OpenGLVertexDeclaration>(surf->vertexDeclaration);
+    const OpenGLVertexDeclaration *vertexDeclaration = static_cast<const OpenGLVertexDeclaration *>(resources.vertexDeclarations.Get(surf->vertexDeclaration));
+    assert(vertexDeclaration && "Stale vertex declaration handle");
     for (const auto &element : vertexDeclaration->vertexElements)
     {
         glEnableVertexAttribArray(element.attributeLocation);
@@ -687,9 +709,9 @@ void OpenGLRenderDevice::Render(const Surface *surf, const ICamera *camera)
     assert(primIndex < _countof(primitiveTable));
     const OpenGLPrimitiveInfo &primitiveInfo = primitiveTable[primIndex];
 
-    if (surf->indexBuffer != nullptr)
+    const OpenGLBuffer *IBO = static_cast<const OpenGLBuffer *>(resources.buffers.Get(surf->indexBuffer));
+    if (IBO != nullptr)
     {
-        const std::shared_ptr<OpenGLBuffer> IBO = std::static_pointer_cast<OpenGLBuffer>(surf->indexBuffer);
         glBindBuffer(IBO->target, IBO->resource);
 
         int32_t numIndices = surf->numIndices;
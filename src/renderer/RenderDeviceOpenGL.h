@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include <GL/glew.h>
+#include "Base/Container/FlatHashMap.h"
 
 namespace renderer
 {
@@ -227,12 +228,17 @@ public:
 
     virtual void Clear(uint32_t targets, const glm::vec4 color, float depth = 1.0f);
     virtual void Render(const Surface *surf, const ICamera *camera);
+    virtual RenderResources *GetResources() { return &resources; }
 
 private:
+    void BindTexture(uint32_t textureIndex, const ITexture *texture);
+    void BindSamplerState(uint32_t textureIndex, const ISamplerState *state);
+
+    RenderResources resources;
     GLuint vaoId;
     std::shared_ptr<OpenGLShaderProgram> currentShaderProgram;
-    std::unordered_map<VertexElementList, std::shared_ptr<OpenGLVertexDeclaration>, VertexElementListHasher> vertexDeclarationCache;
-    std::unordered_map<SamplerStateInitializer, std::shared_ptr<OpenGLSamplerState>, SamplerStateInitializerHasher> samplerStateCache;
+    FlatHashMap<VertexElementList, std::shared_ptr<OpenGLVertexDeclaration>, VertexElementListHasher> vertexDeclarationCache;
+    FlatHashMap<SamplerStateInitializer, std::shared_ptr<OpenGLSamplerState>, SamplerStateInitializerHasher> samplerStateCache;
     uint32_t imageFilterMaxAnisotropy;
     bool isInitialized;
 };
@@ -0,0 +1,239 @@
+#pragma once
+#include <assert.h>
+#include <memory>
+#include <vector>
+#include "Base/Container/FlatHashMap.h"
+
+namespace renderer
+{
+
+// Frames a released resource is kept alive, the GPU may still be using it
+// for frames that are in flight.
+#define RESOURCE_DESTROY_DELAY_FRAMES   2
+
+// 32 bit handle to a resource in a ResourcePool, the low bits are the slot
+// index and the high bits the generation of the slot. Destroying a resource
+// bumps the generation of its slot, so old handles to it resolve to null
+// instead of whatever reuses the slot. A zero handle is never valid.
+template <class T>
+struct ResourceHandle
+{
+    enum
+    {
+        IndexBits = 20,
+        GenerationBits = 12,
+        MaxSlots = 1 << IndexBits,
+        MaxGeneration = (1 << GenerationBits) - 1
+    };
+
+    ResourceHandle() : value(0) {}
+    ResourceHandle(uint32_t index, uint32_t generation) : value((generation << IndexBits) | index) {}
+
+    uint32_t GetIndex() const { return value & (MaxSlots - 1); }
+    uint32_t GetGeneration() const { return value >> IndexBits; }
+    explicit operator bool() const { return value != 0; }
+    bool operator==(const ResourceHandle &other) const { return value == other.value; }
+    bool operator!=(const ResourceHandle &other) const { return value != other.value; }
+
+    uint32_t value;
+};
+
+// Dense slot map of reference counted resources. Resources are kept
+// together in one array, handles find them through a slot array. The
+// reference count isn't atomic, pools are only used from the render
+// thread.
+//
+// Adding the same resource again returns the same handle and adds a
+// reference. When the last reference is released the resource is kept for
+// RESOURCE_DESTROY_DELAY_FRAMES calls to CollectGarbage before the pool
+// drops it.
+//
+// Usage example:
+//  BufferHandle vertexBuffer = resources->buffers.Add(device->CreateBuffer(Buffer_Vertex, vertices, size));
+//  const OpenGLBuffer *buffer = static_cast<const OpenGLBuffer *>(resources->buffers.Get(vertexBuffer));
+//  resources->buffers.Release(vertexBuffer);
+//
+template <class T>
+class ResourcePool
+{
+public:
+    typedef ResourceHandle<T> Handle;
+
+    ResourcePool() : frameIndex(0) {}
+
+    Handle Add(const std::shared_ptr<T> &resource)
+    {
+        if (!resource)
+        {
+            return Handle();
+        }
+
+        Handle &handle = handleByResource[resource.get()];
+        if (handle)
+        {
+            ++entries[slots[handle.GetIndex()].entryIndex].refCount;
+            return handle;
+        }
+
+        uint32_t slotIndex;
+        if (!freeSlots.empty())
+        {
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            assert(slots.size() < Handle::MaxSlots - 1);
+            slotIndex = (uint32_t)slots.size();
+            slots.push_back(Slot{ 0, 1 });
+        }
+
+        Slot &slot = slots[slotIndex];
+        slot.entryIndex = (uint32_t)entries.size();
+        entries.push_back(Entry{ resource, slotIndex, 1, 0 });
+
+        handle = Handle(slotIndex, slot.generation);
+        return handle;
+    }
+
+    void AddRef(Handle handle)
+    {
+        if (handle)
+        {
+            Entry *entry = FindEntry(handle);
+            assert(entry && "Stale resource handle");
+            ++entry->refCount;
+        }
+    }
+
+    void Release(Handle handle)
+    {
+        if (handle)
+        {
+            Entry *entry = FindEntry(handle);
+            assert(entry && entry->refCount > 0 && "Stale resource handle");
+            if (--entry->refCount == 0)
+            {
+                entry->releaseFrame = frameIndex;
+                pendingDestroys.push_back(handle);
+            }
+        }
+    }
+
+    // Resource of handle, or null if the handle is empty or stale.
+    T *Get(Handle handle) const
+    {
+        const Entry *entry = FindEntry(handle);
+        return entry ? entry->resource.get() : nullptr;
+    }
+
+    // Call once per frame, drops the released resources that are old enough.
+    void CollectGarbage()
+    {
+        ++frameIndex;
+
+        // A resource that was added and released again while waiting has
+        // more than one record, the delay counts from its last release
+        size_t numPending = 0;
+        for (size_t pendingIndex = 0; pendingIndex < pendingDestroys.size(); ++pendingIndex)
+        {
+            const Handle handle = pendingDestroys[pendingIndex];
+            const Entry *entry = FindEntry(handle);
+            if (!entry || entry->refCount > 0)
+            {
+                // Already destroyed, or added again
+                continue;
+            }
+
+            if (entry->releaseFrame + RESOURCE_DESTROY_DELAY_FRAMES > frameIndex)
+            {
+                pendingDestroys[numPending++] = handle;
+                continue;
+            }
+
+            Destroy(handle);
+        }
+
+        pendingDestroys.resize(numPending);
+    }
+
+    // Drop every resource at once, outstanding handles become stale.
+    void Clear()
+    {
+        for (const Entry &entry : entries)
+        {
+            Slot &slot = slots[entry.slotIndex];
+            slot.generation = NextGeneration(slot.generation);
+            freeSlots.push_back(entry.slotIndex);
+        }
+
+        entries.clear();
+        pendingDestroys.clear();
+        handleByResource.clear();
+    }
+
+    size_t Num() const { return entries.size(); }
+
+private:
+    struct Slot
+    {
+        uint32_t entryIndex;
+        uint32_t generation;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<T> resource;
+        uint32_t slotIndex;
+        uint32_t refCount;
+        uint64_t releaseFrame;      // Frame the reference count last reached zero
+    };
+
+    static uint32_t NextGeneration(uint32_t generation)
+    {
+        return (generation == Handle::MaxGeneration) ? 1 : generation + 1;
+    }
+
+    const Entry *FindEntry(Handle handle) const
+    {
+        const uint32_t slotIndex = handle.GetIndex();
+        if (!handle || slotIndex >= slots.size() || slots[slotIndex].generation != handle.GetGeneration())
+        {
+            return nullptr;
+        }
+
+        return &entries[slots[slotIndex].entryIndex];
+    }
+
+    Entry *FindEntry(Handle handle)
+    {
+        return const_cast<Entry *>(static_cast<const ResourcePool *>(this)->FindEntry(handle));
+    }
+
+    // Move the last entry into the hole so the entries stay dense
+    void Destroy(Handle handle)
+    {
+        Slot &slot = slots[handle.GetIndex()];
+        const uint32_t entryIndex = slot.entryIndex;
+        handleByResource.erase(entries[entryIndex].resource.get());
+
+        if (entryIndex != entries.size() - 1)
+        {
+            entries[entryIndex] = std::move(entries.back());
+            slots[entries[entryIndex].slotIndex].entryIndex = entryIndex;
+        }
+
+        entries.pop_back();
+        slot.generation = NextGeneration(slot.generation);
+        freeSlots.push_back(handle.GetIndex());
+    }
+
+    std::vector<Entry> entries;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<Handle> pendingDestroys;
+    FlatHashMap<T *, Handle> handleByResource;
+    uint64_t frameIndex;
+};
+
+} // renderer
\ No newline at end of file
@@ -4,7 +4,11 @@
 #include "Base/Sys.h"
 #include "Base/File.h"
 #include "Base/MurmurHash.h"
+#include "Base/Memory.h"
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_MALLOC(size)               TrackedMalloc(size)
+#define STBI_REALLOC(memory, size)      TrackedRealloc(memory, size)
+#define STBI_FREE(memory)               TrackedFree(memory)
 #include "stb_image.h"
 
 namespace renderer
@@ -25,24 +29,22 @@ void TextureCache::Destroy()
 
 void TextureCache::Flush()
 {
-    std::vector<uint32_t> deleteList;
-
-    for (auto cacheEntry : imageCache)
+    for (auto it = imageCache.begin(); it != imageCache.end();)
     {
-        if (cacheEntry.second.use_count() == 1)
+        if (it->second.use_count() == 1)
         {
-            deleteList.push_back(cacheEntry.first);
+            it = imageCache.erase(it);
+        }
+        else
+        {
+            ++it;
         }
-    }
-
-    for (auto textureHash : deleteList)
-    {
-        imageCache.erase(textureHash);
     }
 }
 
 std::shared_ptr<ITexture2D> TextureCache::LoadTexture2DFromFile(const char *filename)
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Textures);
     assert(filename);
 
     const uint32_t hashKey = CalculateMurmurHash(filename, strlen(filename));
@@ -55,13 +57,16 @@ std::shared_ptr<ITexture2D> TextureCache::LoadTexture2DFromFile(const char *file
             DebugPrintf("Loading image from file %s [hash 0x%x]...\n", filename, hashKey);
 
             const size_t textureBufferSize = textureFile.GetLength();
-            const stbi_uc *rawTextureBuffer = new stbi_uc[textureBufferSize];
-            textureFile.Read((uint8_t *)rawTextureBuffer, textureBufferSize);
-
+            unsigned char *data = nullptr;
             int width, height, bpp;
-            stbi_set_flip_vertically_on_load(1);        // convert to opengl texture coordniate system
-            unsigned char *data = stbi_load_from_memory(rawTextureBuffer, (int)textureBufferSize, &width, &height, &bpp, 4);
-            delete[] rawTextureBuffer;
+            {
+                scoped_scratch_buffer rawTextureBuffer(textureBufferSize);
+                textureFile.Read(rawTextureBuffer.Data, textureBufferSize);
+
+                stbi_set_flip_vertically_on_load(1);        // convert to opengl texture coordniate system
+                data = stbi_load_from_memory(rawTextureBuffer.Data, (int)textureBufferSize, &width, &height, &bpp, 4);
+            }
+
             if (!data)
             {
                 Sys_ErrorPrintf("Failed to load image %s: %s\n", filename, stbi_failure_reason());
@@ -90,6 +95,7 @@ std::shared_ptr<ITexture2D> TextureCache::LoadTexture2DFromMemory(const char *na
 
 std::shared_ptr<ITextureCube> TextureCache::LoadTextureCubeFromFiles(const char *filenames[6])
 {
+    MEMORY_TAG_SCOPE(MemoryTag_Textures);
     stbi_uc *imageBuffers[6] = {};
     int32_t cubeWidth = 0;
     int32_t cubeHeight = 0;
@@ -105,16 +111,15 @@ std::shared_ptr<ITextureCube> TextureCache::LoadTextureCubeFromFiles(const char
             DebugPrintf("Loading image from file %s [hash 0x%x]...\n", filename, CalculateMurmurHash(filename, strlen(filename)));
 
             const size_t textureBufferSize = textureFile.GetLength();
-            const stbi_uc *rawTextureBuffer = new stbi_uc[textureBufferSize];
-            textureFile.Read((uint8_t *)rawTextureBuffer, textureBufferSize);
+            scoped_scratch_buffer rawTextureBuffer(textureBufferSize);
+            textureFile.Read(rawTextureBuffer.Data, textureBufferSize);
 
             int width, height, bpp;
             stbi_set_flip_vertically_on_load(1);        // convert to opengl texture coordniate system
 
-            imageBuffers[i] = stbi_load_from_memory(rawTextureBuffer, (int)textureBufferSize, &width, &height, &bpp, 4);
+            imageBuffers[i] = stbi_load_from_memory(rawTextureBuffer.Data, (int)textureBufferSize, &width, &height, &bpp, 4);
             cubeWidth = width;
             cubeHeight = height;
-            delete[] rawTextureBuffer;
             
             if (!imageBuffers[i])
             {
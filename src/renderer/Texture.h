@@ -1,5 +1,6 @@
 #pragma once
 #include "RenderDevice.h"
+#include "Base/Container/FlatHashMap.h"
 
 namespace renderer
 {
@@ -27,7 +28,7 @@ private:
     std::shared_ptr<ITexture2D> ImageFromMemoryInternal(uint32_t hashKey, uint32_t width, uint32_t height, PixelFormat format, const void *pixels);
 
     std::shared_ptr<IRenderDevice> device;
-    std::unordered_map<uint32_t, std::shared_ptr<ITexture2D>> imageCache;
+    FlatHashMap<uint32_t, std::shared_ptr<ITexture2D>> imageCache;
 };
 
 // TODO: This global will do for now, but i don't whant it here